@@ -1,899 +1,2207 @@
-#include <iostream>
-#include <string>
-#include <sstream>
-#include <vector>
-#include <fstream>
-#include <time.h>
-#include <stack>
-#include <queue>
-#include <set>
-#include <chrono>
-
-using namespace std;
-
-// Node Struct
-struct node
+// Huarong.cpp
+// The Huarong CLI: the interactive prompt, the batch solver, the solver daemon
+// and the benchmark suites, built on the solver library (Solver.h).
+#include "Solver.h"
+#include "Huarong.h"
+
+#include <filesystem>
+#include <charconv>
+#include <map>
+#include <cmath>
+#include <list>
+#include <csignal>
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#endif
+
+// Heap allocation counter for the micro-benchmarks (see runMicrobenchmarks).
+// Counting replaces the global operator new, so it is only compiled into the
+// micro-benchmark build (the HuarongMicrobench CMake target).
+#ifdef HUARONG_COUNT_ALLOCATIONS
+atomic<size_t> allocationCount(0);
+
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    if (void* block = malloc(size ? size : 1))
+        return block;
+    throw bad_alloc();
+}
+
+// GCC pairs this free() with the built-in operator new it has inlined at
+// the call site, not with the malloc-based replacement above, and warns.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* block) noexcept { free(block); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+void operator delete(void* block, size_t) noexcept { ::operator delete(block); }
+
+inline size_t allocationsSoFar() { return allocationCount.load(memory_order_relaxed); }
+const bool COUNTING_ALLOCATIONS = true;
+#else
+inline size_t allocationsSoFar() { return 0; }
+const bool COUNTING_ALLOCATIONS = false;
+#endif
+
+// Solution trace formats: every board of every step, or only the cells each step changes
+enum outputFormat
+{
+    FORMAT_TEXT = 0,
+    FORMAT_DELTA = 1
+};
+
+// Puzzles shipped in inputs/, used by the strong-scaling report
+const char* const BUNDLED_PUZZLES[] = { "HR4", "HR10", "HR40", "HR62", "HR81", "HR99", "HR102", "HR138" };
+
+// Recorded as the algorithm of every job in multi-source batch mode, which
+// solves its boards with multiSourceSearch rather than one search each
+const searchAlgorithm MULTI_SOURCE = { "multi", "MULTI", "Multi-source backward search", false, false, true, NULL };
+
+// Exit codes for the batch CLI
+const int EXIT_PUZZLE_ERROR = 1;
+const int EXIT_USAGE = 2;
+const int EXIT_REGRESSION = 3;      // a benchmark result differs from its baseline
+
+// Prototypes
+
+int interactive();
+int runBatch(int argc, char* argv[]);
+int runVariantBatch(const boardVariant& variant, const vector<string>& files, const searchOptions& options, int jobs);
+int runServer(int argc, char* argv[]);
+int runBenchmark(int argc, char* argv[]);
+int runMicrobenchmarks(int argc, char* argv[]);
+vector<gameState> sampleStates(const gameState& startState, size_t count);
+void resetPeakResident();
+size_t peakResidentBytes();
+string getPuzzle();
+void printBoard(const packedBoard& board);
+void parallelScaling();
+void printsolution(const solutionPath& path);
+void reportResult(const string& name, const searchAlgorithm& algorithm, const searchResult& result);
+bool createOutputFile(string name, string algorithm, const solutionPath& path, outputFormat format = FORMAT_TEXT);
+bool writeSolution(ostream& out, const solutionPath& path, outputFormat format);
+bool createSolutionFile(const string& name, const string& algorithm, const solutionPath& path);
+string puzzleStem(const string& file);
+string jsonString(const string& text);
+string progressBreakdown(const searchProgress& progress);
+size_t stateSpaceSize(const gameState& state, const searchOptions& options);
+
+// Progress Reporter Class
+// Prints a progress line for a running search every interval from its own
+// thread, until stopped or destroyed: elapsed time, phase, depth, states
+// expanded and the rate, frontier, duplicates, memory, and an ETA when the
+// size of the state space is known (from a distance database for the board's
+// pieces). The ETA assumes each state is expanded once, so it is an upper
+// bound for BFS-like searches and is dropped once IDA* re-expansions pass it.
+class progressReporter
 {
     public:
-        vector<vector<char>> board;
-        node* parent;
-        node* next;
-        node(vector<vector<char>> board, node* parent = NULL, node* next = NULL)
+        progressReporter(const searchProgress& progress, const string& label, double intervalSeconds, ostream& out, size_t totalStates = 0)
+            : progress(progress), label(label), interval(intervalSeconds), out(out), totalStates(totalStates),
+              started(chrono::steady_clock::now()), worker([this] { run(); }) {}
+        progressReporter(const progressReporter&) = delete;
+        progressReporter& operator=(const progressReporter&) = delete;
+        ~progressReporter() { stop(); }
+
+        void stop()
+        {
+            {
+                lock_guard<mutex> hold(lock);
+                stopping = true;
+            }
+            wake.notify_all();
+            if (worker.joinable())
+                worker.join();
+        }
+
+    private:
+        const searchProgress& progress;
+        string label;
+        chrono::duration<double> interval;
+        ostream& out;
+        size_t totalStates;
+        chrono::steady_clock::time_point started;
+        mutex lock;
+        condition_variable wake;
+        bool stopping = false;
+        thread worker;
+
+        void run()
         {
-            this->board = board;
-            this->parent = parent;
-            this->next = next;
+            unique_lock<mutex> hold(lock);
+            while (!wake.wait_for(hold, interval, [this] { return stopping; }))
+                print();
+        }
+
+        void print()
+        {
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+            uint64_t expanded = progress.expanded.load(memory_order_relaxed);
+            double rate = seconds > 0 ? expanded / seconds : 0;
+
+            ostringstream line;
+            line.setf(ios::fixed);
+            line.precision(1);
+            line << label << ": " << seconds << " s, " << progress.currentPhase() << ", depth " << progress.depth.load(memory_order_relaxed)
+                << ", " << expanded << " expanded (" << uint64_t(rate) << "/s), frontier " << progress.frontier.load(memory_order_relaxed)
+                << ", " << progress.duplicates.load(memory_order_relaxed) << " duplicates";
+            double probe = progress.averageProbe.load(memory_order_relaxed);
+            if (probe > 0)
+                line << ", average probe " << probe;
+            line << ", " << progress.bytes.load(memory_order_relaxed) / (1024 * 1024) << " MB";
+            if (totalStates > expanded && rate > 0)
+                line << ", ETA at most " << (totalStates - expanded) / rate << " s";
+            line << '\n';
+            out << line.str() << flush;
         }
 };
 
-// Blank struct
-struct blank
+// Output Buffer Class
+// Collects formatted output in one reusable block and hands it to the stream in
+// large writes, so a long trace costs a few write calls instead of a flush per
+// row. Whatever is left is written when the buffer goes out of scope.
+class outputBuffer
 {
     public:
-        int rowCord = -1;
-        int colCord = -1;
-};
+        explicit outputBuffer(ostream& out, size_t blockBytes = 1 << 16) : out(out), limit(blockBytes) { block.reserve(blockBytes + 64); }
+        outputBuffer(const outputBuffer&) = delete;
+        outputBuffer& operator=(const outputBuffer&) = delete;
+        ~outputBuffer() { flush(); }
 
-// Prototypes
+        void put(char c)
+        {
+            block.push_back(c);
+            if (block.size() >= limit)
+                flush();
+        }
 
-string getPuzzle();
-vector<vector<char>> buildBoard(string name);
-void printBoard(vector<vector<char>> board);
-string boardState(vector<vector<char>> board);
-void findBlanks(vector<vector<char>> board);
-int makeSingleMove(vector<vector<char>> board, vector<vector<char>> &temp, blank b, string position);
-int makeDoubleMove(vector<vector<char>> board, vector<vector<char>>& temp, string position);
-void bfs(vector<vector<char>> board);
-void dfs(vector<vector<char>> board);
-int checkGoal(vector<vector<char>> board);
-string checkPiece(vector<vector<char>> board, char identifier);
-void printsolution(node* n);
-void createOutputFile(string name, string algorithm, node* solution);
-
-// Global variables
-string puzzleName = "none";
-blank blank1;
-blank blank2;
-int blanksAdjacent = 0;
-string adjacentOrientation = "none";
-
-typedef node* nodeP;
+        void append(const char* text, size_t length)
+        {
+            block.append(text, length);
+            if (block.size() >= limit)
+                flush();
+        }
 
-// MAIN
-int main()
+        void append(const char* text) { append(text, strlen(text)); }
+
+        void number(size_t value)
+        {
+            char digits[24];
+            char* end = to_chars(digits, digits + sizeof(digits), value).ptr;
+            append(digits, size_t(end - digits));
+        }
+
+        void flush()
+        {
+            if (!block.empty())
+                out.write(block.data(), streamsize(block.size()));
+            block.clear();
+        }
+
+    private:
+        ostream& out;
+        string block;
+        size_t limit;
+};
+
+// Solve Cache Class
+// Solutions from earlier runs, one file per (start board, algorithm) in a cache
+// directory shared by every process that names it. An entry holds the start
+// board, the algorithm and the solution as one byte per move (see encodeMove),
+// so a hit replays the exact path the search found. Entries are written to a
+// temporary file and renamed into place, so readers never see a partial entry;
+// a hit refreshes the entry's modification time, and a store prunes the least
+// recently used entries once the directory is over its size limit.
+//
+// Entry layout, native byte order:
+//   header
+//   moves[steps]    uint8 encoded moves from the start board
+class solveCache
 {
-    string name = getPuzzle();
-    puzzleName = name;
+    public:
+        struct header
+        {
+            char magic[4];
+            uint32_t version;
+            char board[BOARD_ROWS * BOARD_COLS];    // boardState() of the start
+            char algorithm[12];                     // searchAlgorithm::name, zero padded
+            uint32_t steps;
+        };
+
+        static const uint32_t VERSION = 1;
+        // A temporary this old belongs to a writer that died before renaming it
+        static constexpr chrono::hours STALE_TEMPORARY{1};
+
+        solveCache(const string& directory, uint64_t limitBytes) : directory(directory), limitBytes(limitBytes), heldBytes(0) {}
+        solveCache(const solveCache&) = delete;
+        solveCache& operator=(const solveCache&) = delete;
+
+        bool open(string& error)
+        {
+            error_code code;
+            filesystem::create_directories(directory, code);
+            if (!filesystem::is_directory(directory, code)) {
+                error = "cannot create cache directory " + directory;
+                return false;
+            }
+            // The limit may be lower than the one the directory was filled under
+            lock_guard<mutex> hold(pruning);
+            prune();
+            return true;
+        }
 
-    while (name != "Q" && name != "Quit" && name != "quit") {
-        vector<vector<char>> board = buildBoard(name);
+        /// <summary>
+        /// Replays a cached solution of a start board
+        /// </summary>
+        /// <param name="start">The start state</param>
+        /// <param name="algorithm">Name of the search that found the solution</param>
+        /// <param name="path">Receives the solution</param>
+        /// <returns>bool: true on a hit whose moves replay to a goal</returns>
+        bool lookup(const gameState& start, const string& algorithm, solutionPath& path) const
+        {
+            string file = entryPath(start, algorithm);
+            ifstream in(file, ios::binary);
+            header h;
+            if (!in.is_open() || !in.read(reinterpret_cast<char*>(&h), sizeof(h)) || !matches(h, start, algorithm))
+                return false;
+
+            // An entry is the header and one byte per move; a corrupt step count
+            // must not size the read
+            error_code code;
+            uintmax_t bytes = filesystem::file_size(file, code);
+            if (code || bytes != sizeof(h) + uintmax_t(h.steps))
+                return false;
+            solutionPath found;
+            found.start = start;
+            found.moves.resize(h.steps);
+            if (!in.read(reinterpret_cast<char*>(found.moves.data()), streamsize(found.moves.size())))
+                return false;
+
+            solutionReplay replay(found);
+            while (replay.next()) {}
+            if (!replay.finished() || !checkGoal(replay.state().board))
+                return false;
+
+            // Reading is a use: keep the entry away from the pruning end
+            filesystem::last_write_time(file, filesystem::file_time_type::clock::now(), code);
+            path = found;
+            return true;
+        }
 
-        int searchMethod = 0;
-        while (searchMethod != 1 && searchMethod != 2) {
-            cout << "   Select a search method:" << endl;
-            cout << "   1. Depth-first Search" << endl;
-            cout << "   2. Breadth-First Search" << endl;
-            cin >> searchMethod;
+        /// <summary>
+        /// Records a solution. Failures are ignored: the cache only ever saves work.
+        /// </summary>
+        void store(const string& algorithm, const solutionPath& path)
+        {
+            header h;
+            memset(&h, 0, sizeof(h));
+            memcpy(h.magic, "HRSC", 4);
+            h.version = VERSION;
+            string board = boardState(path.start.board);
+            memcpy(h.board, board.data(), sizeof(h.board));
+            if (algorithm.size() >= sizeof(h.algorithm))
+                return;
+            memcpy(h.algorithm, algorithm.data(), algorithm.size());
+            h.steps = uint32_t(path.steps());
+
+            // A name no other writer uses, in this process or any other
+            static atomic<unsigned> sequence(0);
+#ifdef _WIN32
+            unsigned long process = GetCurrentProcessId();
+#else
+            unsigned long process = (unsigned long)getpid();
+#endif
+            string file = entryPath(path.start, algorithm);
+            string temporary = file + "." + to_string(process) + "." + to_string(sequence++) + ".tmp";
+            {
+                ofstream out(temporary, ios::binary | ios::trunc);
+                out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+                out.write(reinterpret_cast<const char*>(path.moves.data()), streamsize(path.moves.size()));
+                if (!out) {
+                    out.close();
+                    error_code code;
+                    filesystem::remove(temporary, code);
+                    return;
+                }
+            }
+            error_code code;
+            filesystem::rename(temporary, file, code);
+            if (code) {
+                filesystem::remove(temporary, code);
+                return;
+            }
+
+            // Only rescan the directory once the running total passes the limit.
+            // The total over-counts a replaced entry and misses other processes'
+            // writes; each rescan sets it back to what is on disk.
+            lock_guard<mutex> hold(pruning);
+            heldBytes += sizeof(h) + path.moves.size();
+            if (limitBytes != 0 && heldBytes > limitBytes)
+                prune();
         }
 
-        auto start = chrono::steady_clock::now();
-        if (searchMethod == 1)
-            dfs(board);
-        else if (searchMethod == 2)
-            bfs(board);
+    private:
+        string directory;
+        uint64_t limitBytes;        // 0 for no limit
+        mutex pruning;              // guards heldBytes and the rescans
+        uint64_t heldBytes;         // entry bytes in the directory as of the last rescan, plus stores since
 
-        auto elapsed1 = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
-        auto elapsed2 = chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now() - start);
-        cout << "The elapsed run time is: " << elapsed1.count() << " milliseconds" << " or " << elapsed2.count() << " seconds\n\n";
+        string entryPath(const gameState& start, const string& algorithm) const
+        {
+            // FNV-1a over the board and the algorithm name
+            string key = boardState(start.board) + "/" + algorithm;
+            uint64_t hash = 14695981039346656037ULL;
+            for (size_t i = 0; i < key.size(); i++)
+                hash = (hash ^ uint8_t(key[i])) * 1099511628211ULL;
+            char name[24];
+            snprintf(name, sizeof(name), "%016llx.hrsc", (unsigned long long)hash);
+            return (filesystem::path(directory) / name).string();
+        }
 
+        static bool matches(const header& h, const gameState& start, const string& algorithm)
+        {
+            string board = boardState(start.board);
+            return memcmp(h.magic, "HRSC", 4) == 0 && h.version == VERSION
+                && memcmp(h.board, board.data(), sizeof(h.board)) == 0
+                && algorithm.size() < sizeof(h.algorithm) && strncmp(h.algorithm, algorithm.c_str(), sizeof(h.algorithm)) == 0;
+        }
 
-        name = getPuzzle();
-        puzzleName = name;
-    }
+        /// <summary>
+        /// Rescans the directory: deletes stale temporaries, then the least
+        /// recently used entries until the directory is within its limit, and
+        /// resets heldBytes. Other processes may prune the same directory at the
+        /// same time, so entries that have already gone are skipped. The caller
+        /// holds pruning.
+        /// </summary>
+        void prune()
+        {
+            struct cacheEntry
+            {
+                filesystem::file_time_type used;
+                uint64_t bytes;
+                filesystem::path file;
+            };
+            vector<cacheEntry> entries;
+            uint64_t total = 0;
+            error_code code;
+            filesystem::file_time_type now = filesystem::file_time_type::clock::now();
+            for (filesystem::directory_iterator it(directory, code), end; !code && it != end; it.increment(code)) {
+                error_code entryCode;
+                if (it->path().extension() == ".tmp") {
+                    filesystem::file_time_type written = it->last_write_time(entryCode);
+                    if (!entryCode && now - written > STALE_TEMPORARY)
+                        filesystem::remove(it->path(), entryCode);
+                    continue;
+                }
+                if (it->path().extension() != ".hrsc")
+                    continue;
+                cacheEntry entry = { it->last_write_time(entryCode), it->file_size(entryCode), it->path() };
+                if (entryCode)
+                    continue;
+                total += entry.bytes;
+                entries.push_back(entry);
+            }
+            heldBytes = total;
+            if (limitBytes == 0 || total <= limitBytes)
+                return;
+
+            sort(entries.begin(), entries.end(), [](const cacheEntry& a, const cacheEntry& b) { return a.used < b.used; });
+            for (size_t e = 0; e < entries.size() && total > limitBytes; e++) {
+                filesystem::remove(entries[e].file, code);
+                total -= entries[e].bytes;
+            }
+            heldBytes = total;
+        }
+};
 
-    return 0;
-} // end of main
+// Server Connection Class
+// Where the daemon sends the responses for one client: a socket, or stdout
+// when fd is -1. Workers finish out of order, so each response is written
+// whole under the connection's lock. The socket is closed once the client's
+// reader and every response still owed to it are done with the connection.
+class serverConnection
+{
+    public:
+        explicit serverConnection(int fd = -1) : fd(fd) {}
+        serverConnection(const serverConnection&) = delete;
+        serverConnection& operator=(const serverConnection&) = delete;
+        ~serverConnection()
+        {
+#ifndef _WIN32
+            if (fd >= 0)
+                close(fd);
+#endif
+        }
 
+        int descriptor() const { return fd; }
 
-/// <summary>
-/// Gets input from user for name of the puzzle
-/// </summary>
-/// <returns>string: name of the puzzle</returns>
-string getPuzzle()
+        /// <summary>
+        /// Writes one response line. A client that has gone away loses its
+        /// responses; the daemon carries on.
+        /// </summary>
+        void send(const string& line)
+        {
+            lock_guard<mutex> hold(writing);
+            if (fd < 0) {
+                cout << line << '\n' << flush;
+                return;
+            }
+#ifndef _WIN32
+            string text = line + '\n';
+            for (size_t sent = 0; sent < text.size(); ) {
+                ssize_t written = write(fd, text.data() + sent, text.size() - sent);
+                if (written <= 0)
+                    return;
+                sent += size_t(written);
+            }
+#endif
+        }
+
+    private:
+        int fd;
+        mutex writing;
+};
+
+// Server Request Struct: one board read by the daemon, waiting for a worker
+struct serverRequest
 {
-    string name;
-    cout << "Please enter name of the first puzzle." << endl;
-    cout << "Enter Q or Quit to terminate the program." << endl;
-    cin >> name;
-    return name;
-}
+    string id;
+    huarong::solveRequest request;
+    shared_ptr<serverConnection> connection;
+    chrono::steady_clock::time_point arrived;
+};
 
-/// <summary>
-/// Builds the initial board state from the puzzle name
-/// </summary>
-/// <param name="name">name of the puzzle</param>
-/// <returns>vector<vector<char>>: 2D array of the initial game board</returns>
-vector<vector<char>> buildBoard(string name)
+// Server Queue Class
+// Requests from every client, taken by the daemon's workers. A worker takes
+// up to batchSize per lock, but only while every other worker is busy and
+// never more than its share of what is waiting, so no request sits behind
+// another while a worker is idle. Once closed, take() hands out what is left
+// and then returns false.
+class serverQueue
 {
-    vector<vector<char>> vect;
+    public:
+        serverQueue(size_t batchSize, size_t workers) : batchSize(max<size_t>(batchSize, 1)), workers(max<size_t>(workers, 1)) {}
 
-    ifstream file;
-    file.open("inputs/" + name + ".in");
-    
-    string line;
-    if (file.is_open()) {
-        while (getline(file, line)) {
-            istringstream iss(line);
-            vector<char> row;
-            char elems[4];
-            iss >> elems[0] >> elems[1] >> elems[2] >> elems[3];
+        void push(serverRequest request)
+        {
+            {
+                lock_guard<mutex> hold(lock);
+                waiting.push_back(move(request));
+            }
+            ready.notify_one();
+        }
 
-            for (int i = 0; i < 4; i++) {
-                row.push_back(elems[i]);
+        void close()
+        {
+            {
+                lock_guard<mutex> hold(lock);
+                closed = true;
             }
+            ready.notify_all();
+        }
 
-            vect.push_back(row);
+        bool take(vector<serverRequest>& batch)
+        {
+            batch.clear();
+            unique_lock<mutex> hold(lock);
+            idle++;
+            ready.wait(hold, [this] { return closed || !waiting.empty(); });
+            idle--;
+
+            size_t share = idle > 0 ? 1 : min(batchSize, (waiting.size() + workers - 1) / workers);
+            while (!waiting.empty() && batch.size() < share) {
+                batch.push_back(move(waiting.front()));
+                waiting.pop_front();
+            }
+            bool more = !waiting.empty() && idle > 0;
+            hold.unlock();
+            if (more)
+                ready.notify_one();
+            return !batch.empty();
         }
-    }
-    else {
-        cout << "There is no puzzle matching this name" << endl;
-        exit(-1);
-    }
 
-    return vect;
-}
+    private:
+        size_t batchSize;
+        size_t workers;
+        size_t idle = 0;        // workers waiting in take()
+        deque<serverRequest> waiting;
+        bool closed = false;
+        mutex lock;
+        condition_variable ready;
+};
 
 /// <summary>
-/// Prints the board in a 2D form
+/// Formats the daemon's response to one request (see runServer)
 /// </summary>
-/// <param name="board">Board to be printed</param>
-void printBoard(vector<vector<char>> board)
+/// <param name="pending">The request</param>
+/// <param name="result">What solving it gave</param>
+/// <param name="started">When a worker took it, or when it was read if no worker did</param>
+/// <returns>string: the JSON line, without its newline</returns>
+string serverResponse(const serverRequest& pending, const huarong::solveResult& result, chrono::steady_clock::time_point started)
 {
-    for (int i = 0; i < board.size(); i++) {
-        for (int j = 0; j < board[i].size(); j++) {
-            cout << board[i][j] << " ";
+    ostringstream response;
+    response << "{\"id\":" << jsonString(pending.id) << ",\"algorithm\":" << jsonString(pending.request.algorithm)
+        << ",\"status\":\"" << result.status << "\"";
+    if (result.status == "solved") {
+        response << ",\"steps\":" << result.moves.size() << ",\"moves\":\"";
+        for (size_t m = 0; m < result.moves.size(); m++) {
+            const huarong::solveMove& move = result.moves[m];
+            response << (m ? " " : "") << move.piece << move.direction;
+            if (move.secondDirection)
+                response << move.secondDirection;
         }
-        cout << endl;
+        response << "\"";
     }
+    else if (result.status == "limit")
+        response << ",\"limit\":\"" << result.limit << "\",\"deepest\":" << result.deepest
+            << ",\"king_distance\":" << result.kingDistance;
+    else if (result.status == "error")
+        response << ",\"error\":" << jsonString(result.error);
+
+    auto answered = chrono::steady_clock::now();
+    response << ",\"expanded\":" << result.expanded << ",\"peak_kb\":" << result.peakBytes / 1024
+        << ",\"queue_ms\":" << chrono::duration<double, milli>(started - pending.arrived).count()
+        << ",\"solve_ms\":" << result.ms
+        << ",\"total_ms\":" << chrono::duration<double, milli>(answered - pending.arrived).count() << "}";
+    return response.str();
 }
 
+// MAIN
+// With no arguments the solver runs the interactive prompt; with arguments it
+// runs the batch CLI (see runBatch), the solver daemon when the first argument
+// is --serve (see runServer), or the benchmark suites when it is --bench or
+// --microbench (see runBenchmark, runMicrobenchmarks).
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && string(argv[1]) == "--serve")
+        return runServer(argc, argv);
+    if (argc > 1 && string(argv[1]) == "--bench")
+        return runBenchmark(argc, argv);
+    if (argc > 1 && string(argv[1]) == "--microbench")
+        return runMicrobenchmarks(argc, argv);
+    if (argc > 1)
+        return runBatch(argc, argv);
+    return interactive();
+} // end of main
+
 /// <summary>
-/// Transforms a 2D board into a string
+/// Interactive loop: prompts for a puzzle in inputs/ and a search method until
+/// the user quits
 /// </summary>
-/// <param name="board">The board to be transformed</param>
-/// <returns>string: string representation of the board</returns>
-string boardState(vector<vector<char>> board)
+/// <returns>int: process exit code, nonzero if a puzzle could not be loaded</returns>
+int interactive()
 {
-    string state = "";
-    for (int i = 0; i < board.size(); i++) {
-        for (int j = 0; j < board[i].size(); j++) {
-            state.append(1, board[i][j]);
+    string name = getPuzzle();
+
+    while (name != "Q" && name != "Quit" && name != "quit") {
+        gameState board;
+        string error;
+        if (!loadBoard("inputs/" + name + ".in", board, error)) {
+            cout << "There is no puzzle matching this name" << endl;
+            return EXIT_PUZZLE_ERROR;
+        }
+
+        // The scaling report comes after the searches
+        int searchMethod = 0;
+        while (searchMethod < 1 || searchMethod > ALGORITHM_COUNT + 1) {
+            cout << "   Select a search method:" << endl;
+            for (int a = 0; a < ALGORITHM_COUNT; a++)
+                cout << "   " << a + 1 << ". " << SEARCH_ALGORITHMS[a].label << endl;
+            cout << "   " << ALGORITHM_COUNT + 1 << ". Parallel BFS strong-scaling report (all bundled puzzles)" << endl;
+            cin >> searchMethod;
         }
+
+        const searchAlgorithm* algorithm = searchMethod <= ALGORITHM_COUNT ? &SEARCH_ALGORITHMS[searchMethod - 1] : NULL;
+        searchOptions options;
+        if (algorithm && algorithm->parallel) {
+            cout << "   Enter the number of threads (0 for one per core):" << endl;
+            cin >> options.threads;
+        }
+
+        distanceDatabase database;
+        if (algorithm && algorithm->database) {
+            string file;
+            cout << "   Enter the distance database file (built with --build-db):" << endl;
+            cin >> file;
+            if (!database.load(file, error))
+                cout << error << endl;
+            else
+                options.databases.push_back(&database);
+        }
+
+        auto start = chrono::steady_clock::now();
+        if (algorithm) {
+            cout << "Running " << algorithm->label << "....." << endl;
+            searchProgress progress;
+            searchResult result;
+            if (SEARCH_STATS) {
+                options.progress = &progress;
+                progressReporter reporter(progress, algorithm->name, 1.0, cout, stateSpaceSize(board, options));
+                result = runSearch(*algorithm, board, options);
+            }
+            else
+                result = runSearch(*algorithm, board, options);
+            reportResult(name, *algorithm, result);
+            if (SEARCH_STATS)
+                cout << progressBreakdown(progress);
+        }
+        else
+            parallelScaling();
+
+        auto elapsed1 = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+        auto elapsed2 = chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now() - start);
+        cout << "The elapsed run time is: " << elapsed1.count() << " milliseconds" << " or " << elapsed2.count() << " seconds\n\n";
+
+
+        name = getPuzzle();
     }
-    return state;
+
+    return 0;
 }
 
 /// <summary>
-/// Checks to see if a puzzle has successfully been completed
+/// Batch CLI: solves many puzzles in one process without prompting.
+///   Huarong [options] puzzle.in ...
+///     --manifest FILE     read jobs from FILE, one "puzzle-file [algorithm]" per line
+///     --algorithm NAME    algorithm for jobs that do not name one (default bfs)
+///     --jobs N            puzzles solved at once (default one per core)
+///     --threads N         threads for each parallel search (default 1)
+///     --out-dir DIR       also write each solution file into DIR, created if
+///                         missing; "-" streams each trace to stdout after its
+///                         record instead
+///     --format FMT        trace format: text (.out, default) or delta (.delta,
+///                         only the cells each step changes; see writeSolution)
+///     --binary            with --out-dir, also write each solution as a .sol
+///                         move list (see createSolutionFile)
+///     --db FILE           distance database for the db algorithm; repeat for
+///                         several layouts, each board uses the one for its pieces
+///     --multi-source      solve every puzzle with one backward search from the
+///                         goals per piece inventory, instead of a search each;
+///                         records show algorithm "multi" and the shared search's
+///                         expansions and time (see multiSourceSearch)
+///     --geometry NAME     read the puzzles as boards of another size or piece
+///                         set and solve them with bfs (see runVariantBatch)
+///     --max-seconds S     stop any search that runs longer than S seconds
+///     --max-nodes N       stop any search after N expanded states
+///     --max-mb MB         stop any search whose structures pass MB megabytes
+///                         (a stopped search gets a "limit" record with the
+///                         deepest depth and closest king distance it reached);
+///                         ebfs keeps within it by spilling layers to disk instead
+///     --spill-dir DIR     where ebfs writes its layer files (default the
+///                         system temporary directory)
+///     --progress SECONDS  print a progress line for each running search to
+///                         stderr this often, and its phase breakdown at the end
+///     --cache DIR         reuse solutions stored in DIR by earlier runs, and
+///                         store new ones there
+///     --cache-limit MB    prune the least recently used entries beyond this
+///                         size (default 64, 0 for no limit)
+///   Huarong --build-db puzzle.in [--db FILE]
+///     enumerates the puzzle's piece inventory into a distance database
+///     (FILE defaults to the puzzle name with .hrdb)
+///   Huarong --serve ...
+///     runs the solver daemon (see runServer)
+///   Huarong --bench ...
+///     runs the benchmark suite (see runBenchmark)
+///   Huarong --microbench ...
+///     times the per-node kernels (see runMicrobenchmarks)
+/// Prints one JSON record per puzzle to stdout as each one finishes.
 /// </summary>
-/// <param name="board">The board to check the goal completion state against</param>
-/// <returns>int: 1 for success (goal completed), 0 for failure</returns>
-int checkGoal(vector<vector<char>> board)
+/// <returns>int: 0 if every puzzle loaded and ran, EXIT_PUZZLE_ERROR if any failed,
+/// EXIT_USAGE for a bad command line</returns>
+int runBatch(int argc, char* argv[])
 {
-    if (board[3][1] == '0' && board[4][1] == '0' && board[3][2] == '0' && board[4][2] == '0')
-        return 1;
-    else
+    struct batchJob
+    {
+        string file;
+        const searchAlgorithm* algorithm;
+    };
+
+    auto findAlgorithm = [](const string& name) -> const searchAlgorithm* {
+        for (int a = 0; a < ALGORITHM_COUNT; a++) {
+            if (name == SEARCH_ALGORITHMS[a].name)
+                return &SEARCH_ALGORITHMS[a];
+        }
+        return NULL;
+    };
+
+    const searchAlgorithm* fallback = findAlgorithm("bfs");
+    vector<string> files;
+    vector<string> manifests;
+    int jobs = 0;
+    searchOptions options;
+    options.threads = 1;
+    string outDir;
+    vector<string> databaseFiles;
+    string buildFrom;
+    string cacheDir;
+    uint64_t cacheLimit = 64;
+    bool binary = false;
+    outputFormat format = FORMAT_TEXT;
+    double progressInterval = 0;
+    bool multiSource = false;
+    const boardVariant* variant = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--help" || arg == "-h") {
+            cout << "usage: Huarong [--manifest FILE] [--algorithm NAME] [--jobs N] [--threads N] [--out-dir DIR] [--format text|delta] [--binary] [--max-seconds S] [--max-nodes N] [--max-mb MB] [--spill-dir DIR] [--progress SECONDS] [--db FILE] [--multi-source] [--geometry NAME] [--cache DIR] [--cache-limit MB] puzzle.in ..." << endl;
+            cout << "       Huarong --build-db puzzle.in [--db FILE]" << endl;
+            cout << "       Huarong --serve [--help]" << endl;
+            cout << "       Huarong --bench [--help]" << endl;
+            cout << "       Huarong --microbench [--help]" << endl;
+            cout << "algorithms:";
+            for (int a = 0; a < ALGORITHM_COUNT; a++)
+                cout << " " << SEARCH_ALGORITHMS[a].name;
+            cout << endl;
+            cout << "geometries:";
+            for (int v = 0; v < VARIANT_COUNT; v++)
+                cout << " " << BOARD_VARIANTS[v].name;
+            cout << endl;
+            return 0;
+        }
+        else if (arg == "--manifest" && hasValue)
+            manifests.push_back(argv[++i]);
+        else if (arg == "--algorithm" && hasValue) {
+            fallback = findAlgorithm(argv[++i]);
+            if (!fallback) {
+                cerr << "Unknown algorithm: " << argv[i] << endl;
+                return EXIT_USAGE;
+            }
+        }
+        else if (arg == "--jobs" && hasValue)
+            jobs = atoi(argv[++i]);
+        else if (arg == "--threads" && hasValue)
+            options.threads = atoi(argv[++i]);
+        else if (arg == "--out-dir" && hasValue)
+            outDir = argv[++i];
+        else if (arg == "--db" && hasValue)
+            databaseFiles.push_back(argv[++i]);
+        else if (arg == "--build-db" && hasValue)
+            buildFrom = argv[++i];
+        else if (arg == "--binary")
+            binary = true;
+        else if (arg == "--multi-source")
+            multiSource = true;
+        else if (arg == "--geometry" && hasValue) {
+            string name = argv[++i];
+            for (int v = 0; v < VARIANT_COUNT && !variant; v++) {
+                if (name == BOARD_VARIANTS[v].name)
+                    variant = &BOARD_VARIANTS[v];
+            }
+            if (!variant) {
+                cerr << "Unknown geometry: " << name << endl;
+                return EXIT_USAGE;
+            }
+        }
+        else if (arg == "--progress" && hasValue)
+            progressInterval = atof(argv[++i]);
+        else if (arg == "--max-seconds" && hasValue)
+            options.maxSeconds = atof(argv[++i]);
+        else if (arg == "--max-nodes" && hasValue)
+            options.maxExpanded = atol(argv[++i]);
+        else if (arg == "--max-mb" && hasValue)
+            options.maxBytes = size_t(strtoull(argv[++i], NULL, 10)) * 1024 * 1024;
+        else if (arg == "--spill-dir" && hasValue)
+            options.spillDirectory = argv[++i];
+        else if (arg == "--format" && hasValue) {
+            string name = argv[++i];
+            if (name == "text")
+                format = FORMAT_TEXT;
+            else if (name == "delta")
+                format = FORMAT_DELTA;
+            else {
+                cerr << "Unknown format: " << name << endl;
+                return EXIT_USAGE;
+            }
+        }
+        else if (arg == "--cache" && hasValue)
+            cacheDir = argv[++i];
+        else if (arg == "--cache-limit" && hasValue)
+            cacheLimit = strtoull(argv[++i], NULL, 10);
+        else if (arg.size() > 1 && arg[0] == '-') {
+            cerr << "Unknown or incomplete option: " << arg << endl;
+            return EXIT_USAGE;
+        }
+        else
+            files.push_back(arg);
+    }
+
+    if (!buildFrom.empty()) {
+        string databaseFile = databaseFiles.empty() ? puzzleStem(buildFrom) + ".hrdb" : databaseFiles[0];
+
+        gameState board;
+        distanceDatabase database;
+        string error;
+        auto start = chrono::steady_clock::now();
+        if (!loadBoard(buildFrom, board, error) || !buildDistanceDatabase(board, database, error) || !database.save(databaseFile, error)) {
+            cout << "{\"database\":" << jsonString(databaseFile) << ",\"status\":\"error\",\"error\":" << jsonString(error) << "}" << endl;
+            return EXIT_PUZZLE_ERROR;
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "{\"database\":" << jsonString(databaseFile) << ",\"status\":\"built\",\"states\":" << database.size()
+            << ",\"max_distance\":" << database.info().maxDistance << ",\"bytes\":" << database.fileBytes()
+            << ",\"ms\":" << ms << "}" << endl;
         return 0;
-}
+    }
 
-/// <summary>
-/// Moves a single blank square either up, down, left, or right
-/// </summary>
-/// <param name="board">The state of the board to be used (passed by value)</param>
-/// <param name="temp">2D board that is edited in the function (passed by reference)</param>
-/// <param name="b">Global variable blank piece</param>
-/// <param name="position">Up, down, left, or right</param>
-/// <returns></returns>
-int makeSingleMove(vector<vector<char>> board, vector<vector<char>> &temp, blank b, string position)
-{
-    // Set temporary board to the current board state
-    temp = board;
+    vector<unique_ptr<distanceDatabase>> databases;
+    for (size_t d = 0; d < databaseFiles.size(); d++) {
+        string error;
+        databases.push_back(unique_ptr<distanceDatabase>(new distanceDatabase()));
+        if (!databases.back()->load(databaseFiles[d], error)) {
+            cerr << error << endl;
+            return EXIT_USAGE;
+        }
+        options.databases.push_back(databases.back().get());
+    }
 
-    // Up
-    if (position == "up") {
-        if (b.rowCord == 0)
-            return 0;
-        
-        char adjacentIdentifier = board[b.rowCord - 1][b.colCord];
-        string pieceType = checkPiece(board, adjacentIdentifier);
-        if (pieceType == "vertical") {
-            temp[b.rowCord][b.colCord] = adjacentIdentifier;
-            temp[b.rowCord - 2][b.colCord] = 'b';
-            return 1;
-        }
-        else if (pieceType == "square") {
-            temp[b.rowCord][b.colCord] = adjacentIdentifier;
-            temp[b.rowCord - 1][b.colCord] = 'b';
-            return 1;
-        }
-    }
-    // Down
-    else if (position == "down") {
-        if (b.rowCord == 4)
-            return 0;
+    if (variant && (multiSource || !outDir.empty() || !cacheDir.empty())) {
+        cerr << "--geometry cannot be combined with --multi-source, --out-dir or --cache" << endl;
+        return EXIT_USAGE;
+    }
 
-        char adjacentIdentifier = board[b.rowCord + 1][b.colCord];
-        string pieceType = checkPiece(board, adjacentIdentifier);
-        if (pieceType == "vertical") {
-            temp[b.rowCord][b.colCord] = adjacentIdentifier;
-            temp[b.rowCord + 2][b.colCord] = 'b';
-            return 1;
+    bool toStdout = outDir == "-";
+    if (toStdout && binary) {
+        cerr << "--binary needs a directory for --out-dir" << endl;
+        return EXIT_USAGE;
+    }
+    if (!outDir.empty() && !toStdout) {
+        error_code code;
+        filesystem::create_directories(outDir, code);
+        if (code || !filesystem::is_directory(outDir)) {
+            cerr << "Cannot create --out-dir " << outDir << (code ? ": " + code.message() : "") << endl;
+            return EXIT_USAGE;
         }
-        else if (pieceType == "square") {
-            temp[b.rowCord][b.colCord] = adjacentIdentifier;
-            temp[b.rowCord + 1][b.colCord] = 'b';
-            return 1;
+    }
+
+    unique_ptr<solveCache> cache;
+    if (!cacheDir.empty()) {
+        string error;
+        cache.reset(new solveCache(cacheDir, cacheLimit * 1024 * 1024));
+        if (!cache->open(error)) {
+            cerr << error << endl;
+            return EXIT_USAGE;
         }
     }
-    // Left
-    else if (position == "left") {
-        if (b.colCord == 0)
-            return 0;
 
-        char adjacentIdentifier = board[b.rowCord][b.colCord - 1];
-        string pieceType = checkPiece(board, adjacentIdentifier);
-        if (pieceType == "horizontal") {
-            temp[b.rowCord][b.colCord] = adjacentIdentifier;
-            temp[b.rowCord][b.colCord - 2] = 'b';
-            return 1;
+    vector<batchJob> queue;
+    for (size_t m = 0; m < manifests.size(); m++) {
+        ifstream manifest(manifests[m]);
+        if (!manifest.is_open()) {
+            cerr << "Cannot open manifest: " << manifests[m] << endl;
+            return EXIT_USAGE;
         }
-        else if (pieceType == "square") {
-            temp[b.rowCord][b.colCord] = adjacentIdentifier;
-            temp[b.rowCord][b.colCord - 1] = 'b';
-            return 1;
+        string line;
+        int lineNumber = 0;
+        while (getline(manifest, line)) {
+            lineNumber++;
+            istringstream iss(line);
+            string file, name;
+            if (!(iss >> file) || file[0] == '#')
+                continue;
+            const searchAlgorithm* algorithm = fallback;
+            if (iss >> name && !(algorithm = findAlgorithm(name))) {
+                cerr << manifests[m] << ":" << lineNumber << ": unknown algorithm " << name << endl;
+                return EXIT_USAGE;
+            }
+            queue.push_back({ file, algorithm });
         }
     }
-    // Right
-    else if (position == "right") {
-        if (b.colCord == 3)
-            return 0;
+    for (size_t f = 0; f < files.size(); f++)
+        queue.push_back({ files[f], fallback });
+
+    if (queue.empty()) {
+        cerr << "No puzzles given; see --help" << endl;
+        return EXIT_USAGE;
+    }
+    if (variant) {
+        vector<string> puzzles;
+        for (size_t j = 0; j < queue.size(); j++) {
+            if (string(queue[j].algorithm->name) != "bfs") {
+                cerr << "--geometry solves with bfs only, not " << queue[j].algorithm->name << endl;
+                return EXIT_USAGE;
+            }
+            puzzles.push_back(queue[j].file);
+        }
+        return runVariantBatch(*variant, puzzles, options, jobs);
+    }
 
-        char adjacentIdentifier = board[b.rowCord][b.colCord + 1];
-        string pieceType = checkPiece(board, adjacentIdentifier);
-        if (pieceType == "horizontal") {
-            temp[b.rowCord][b.colCord] = adjacentIdentifier;
-            temp[b.rowCord][b.colCord + 2] = 'b';
-            return 1;
+    // Multi-source mode solves every board up front; the jobs below only report
+    // the results. Boards that do not load are left out and fail in their job.
+    vector<searchResult> shared(multiSource ? queue.size() : 0);
+    double sharedMs = 0;
+    if (multiSource) {
+        vector<gameState> boards;
+        vector<size_t> owners;
+        for (size_t j = 0; j < queue.size(); j++) {
+            gameState board;
+            string error;
+            queue[j].algorithm = &MULTI_SOURCE;
+            if (loadBoard(queue[j].file, board, error)) {
+                boards.push_back(board);
+                owners.push_back(j);
+            }
         }
-        else if (pieceType == "square") {
-            temp[b.rowCord][b.colCord] = adjacentIdentifier;
-            temp[b.rowCord][b.colCord + 1] = 'b';
-            return 1;
+
+        auto start = chrono::steady_clock::now();
+        vector<searchResult> found;
+        if (SEARCH_STATS && progressInterval > 0) {
+            searchOptions watched = options;
+            searchProgress progress;
+            watched.progress = &progress;
+            {
+                progressReporter reporter(progress, "multi-source", progressInterval, cerr);
+                found = multiSourceSearch(boards, watched);
+            }
+            cerr << "multi-source breakdown:\n" << progressBreakdown(progress) << flush;
         }
+        else
+            found = multiSourceSearch(boards, options);
+        sharedMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        for (size_t b = 0; b < owners.size(); b++)
+            shared[owners[b]] = found[b];
     }
-    return 0;
+
+    workerPool pool(min(threadCount(jobs), int(queue.size())));
+    atomic<size_t> nextJob(0);
+    atomic<bool> failed(false);
+    mutex output;
+
+    pool.run([&](int) {
+        for (size_t j = nextJob++; j < queue.size(); j = nextJob++) {
+            const batchJob& job = queue[j];
+            ostringstream record;
+            record << "{\"puzzle\":" << jsonString(job.file) << ",\"algorithm\":\"" << job.algorithm->name << "\"";
+
+            gameState board;
+            string error;
+            solutionPath trace;
+            bool traced = false;
+            if (loadBoard(job.file, board, error)) {
+                try {
+                    auto start = chrono::steady_clock::now();
+                    searchResult result;
+                    bool cached = cache && cache->lookup(board, job.algorithm->name, result.path);
+                    if (cached)
+                        result.solved = true;
+                    else if (multiSource)
+                        result = shared[j];
+                    else if (SEARCH_STATS && progressInterval > 0) {
+                        searchOptions watched = options;
+                        searchProgress progress;
+                        watched.progress = &progress;
+                        {
+                            progressReporter reporter(progress, job.file + " " + job.algorithm->name, progressInterval, cerr, stateSpaceSize(board, options));
+                            result = runSearch(*job.algorithm, board, watched);
+                        }
+                        string breakdown = progressBreakdown(progress);
+                        lock_guard<mutex> hold(output);
+                        cerr << job.file << " " << job.algorithm->name << " breakdown:\n" << breakdown << flush;
+                    }
+                    else
+                        result = runSearch(*job.algorithm, board, options);
+                    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                    if (multiSource && !cached)
+                        ms = sharedMs;
+                    if (!result.error.empty())
+                        throw runtime_error(result.error);
+                    if (cache && !cached && result.solved)
+                        cache->store(job.algorithm->name, result.path);
+
+                    if (result.solved && !outDir.empty() && !toStdout) {
+                        string name = outDir + "/" + puzzleStem(job.file);
+                        if (!createOutputFile(name, job.algorithm->tag, result.path, format))
+                            throw runtime_error("cannot write the solution file for " + name + job.algorithm->tag);
+                        if (binary && !createSolutionFile(name, job.algorithm->tag, result.path))
+                            throw runtime_error("cannot write " + name + job.algorithm->tag + ".sol");
+                    }
+
+                    if (result.solved)
+                        record << ",\"status\":\"solved\",\"steps\":" << result.path.steps();
+                    else if (result.limit != LIMIT_NONE)
+                        record << ",\"status\":\"limit\",\"limit\":\"" << limitName(result.limit) << "\",\"deepest\":" << result.deepest
+                            << ",\"king_distance\":" << result.closestKing;
+                    else
+                        record << ",\"status\":\"unsolved\"";
+                    record << ",\"expanded\":" << result.expanded << ",\"ms\":" << ms
+                        << ",\"peak_kb\":" << result.peakBytes / 1024;
+                    if (cached)
+                        record << ",\"cached\":true";
+
+                    traced = result.solved && toStdout;
+                    if (traced)
+                        trace = result.path;
+                }
+                catch (const exception& e) {
+                    error = e.what();
+                }
+            }
+            if (!error.empty()) {
+                record << ",\"status\":\"error\",\"error\":" << jsonString(error);
+                failed = true;
+            }
+            record << "}";
+
+            // A streamed trace follows its record, so the two are never interleaved with another job's
+            lock_guard<mutex> hold(output);
+            cout << record.str() << '\n';
+            if (traced)
+                writeSolution(cout, trace, format);
+            cout.flush();
+        }
+    });
+
+    return failed ? EXIT_PUZZLE_ERROR : 0;
 }
 
 /// <summary>
-/// Moves adjacent blank square either up, down, left, or right
+/// Batch CLI for --geometry: solves each puzzle as a board of the variant's
+/// geometry with variantBfs. Records carry the geometry and the solution as
+/// moves ("7U" is one cell up, "4RD" two cells right then down), since these
+/// boards have no solution files.
 /// </summary>
-/// <param name="board">The state of the board to be used (passed by value)</param>
-/// <param name="temp">2D board that is edited in the function (passed by reference)</param>
-/// <param name="position">Up, down, left, or right</param>
-/// <returns></returns>
-int makeDoubleMove(vector<vector<char>> board, vector<vector<char>>& temp, string position)
+/// <param name="variant">The geometry to read the puzzles as</param>
+/// <param name="files">The puzzle files</param>
+/// <param name="options">Budget for every search</param>
+/// <param name="jobs">Puzzles solved at once, 0 for one per core</param>
+/// <returns>int: 0 if every puzzle loaded and ran, EXIT_PUZZLE_ERROR if any failed</returns>
+int runVariantBatch(const boardVariant& variant, const vector<string>& files, const searchOptions& options, int jobs)
 {
-    // Set temporary board to the current board state
-    temp = board;
-
-    // Up
-    if (position == "up") {
-        if (blank1.rowCord == 0 || blank2.rowCord == 0)
-            return 0;
+    workerPool pool(min(threadCount(jobs), int(files.size())));
+    atomic<size_t> nextJob(0);
+    atomic<bool> failed(false);
+    mutex output;
+
+    pool.run([&](int) {
+        for (size_t j = nextJob++; j < files.size(); j = nextJob++) {
+            ostringstream record;
+            record << "{\"puzzle\":" << jsonString(files[j]) << ",\"geometry\":\"" << variant.name << "\",\"algorithm\":\"bfs\"";
+
+            ifstream input(files[j]);
+            variantResult result;
+            auto start = chrono::steady_clock::now();
+            if (!input.is_open())
+                result.error = "cannot open " + files[j];
+            else
+                result = variant.solve(input, options);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
 
-        if (adjacentOrientation == "horizontal") {
-            char p1ID = board[blank1.rowCord - 1][blank1.colCord];
-            char p2ID = board[blank2.rowCord - 1][blank2.colCord];
-
-            if ((p1ID == p2ID && p1ID != '0') || (checkPiece(board, p1ID) == "square" && checkPiece(board, p2ID) == "square")) {
-                temp[blank1.rowCord - 1][blank1.colCord] = 'b';
-                temp[blank2.rowCord - 1][blank2.colCord] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
-            }
-            else if (checkPiece(board, p1ID) == "vertical" && checkPiece(board, p2ID) == "vertical") {
-                temp[blank1.rowCord - 2][blank1.colCord] = 'b';
-                temp[blank2.rowCord - 2][blank2.colCord] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
-            }
-            else if (checkPiece(board, p1ID) == "king" && checkPiece(board, p2ID) == "king") {
-                temp[blank1.rowCord - 2][blank1.colCord] = 'b';
-                temp[blank2.rowCord - 2][blank2.colCord] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
+            if (!result.error.empty()) {
+                record << ",\"status\":\"error\",\"error\":" << jsonString(result.error);
+                failed = true;
             }
-            else
-                return 0;
-        }
-        else if (adjacentOrientation == "vertical") {
-            if (blank1.rowCord - 2 < 0 || blank2.rowCord - 2 < 0) {
-                char p1ID = board[blank1.rowCord - 1][blank1.colCord];
-                if (checkPiece(board, p1ID) == "square") {
-                    temp[blank1.rowCord - 1][blank1.colCord] = 'b';
-                    temp[blank2.rowCord][blank2.colCord] = p1ID;
-                    return 1;
+            else {
+                if (result.solved) {
+                    string moves;
+                    for (size_t m = 0; m < result.moves.size(); m++)
+                        moves += (m ? " " : "") + moveText(result.moves[m]);
+                    record << ",\"status\":\"solved\",\"steps\":" << result.moves.size() << ",\"moves\":" << jsonString(moves);
                 }
+                else if (result.limit != LIMIT_NONE)
+                    record << ",\"status\":\"limit\",\"limit\":\"" << limitName(result.limit) << "\",\"deepest\":" << result.deepest;
                 else
-                    return 0;
+                    record << ",\"status\":\"unsolved\"";
+                record << ",\"expanded\":" << result.expanded << ",\"ms\":" << ms
+                    << ",\"peak_kb\":" << result.peakBytes / 1024;
             }
+            record << "}";
 
-            char p1ID = board[blank1.rowCord - 1][blank1.colCord];
-            char p2ID = board[blank1.rowCord - 2][blank1.colCord];
+            lock_guard<mutex> hold(output);
+            cout << record.str() << endl;
+        }
+    });
 
-            if (p1ID == '0' || p2ID == '0')
-                return 0;
+    return failed ? EXIT_PUZZLE_ERROR : 0;
+}
 
-            if (p1ID == p2ID) {
-                temp[blank1.rowCord - 1][blank1.colCord] = 'b';
-                temp[blank1.rowCord - 2][blank1.colCord] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
-            }
-            else if (checkPiece(board, p1ID) == "square")
-            {
-                temp[blank1.rowCord - 1][blank1.colCord] = 'b';
-                temp[blank2.rowCord][blank2.colCord] = p1ID;
-                return 1;
-            }
-            else
-                return 0;
+// Set by SIGINT and SIGTERM to stop the daemon's listener, which runs on its own thread
+atomic<bool> serverStopping(false);
+
+/// <summary>
+/// Solver daemon: reads boards from clients and answers each as soon as it is
+/// solved, keeping the workers and their search memory warm between requests.
+///   Huarong --serve [options]
+///     --socket PATH       listen on a Unix domain socket at PATH, one reader
+///                         per client (default: read stdin, answer on stdout)
+///     --workers N         boards solved at once (default one per core)
+///     --batch N           most requests a worker takes from the queue at a
+///                         time, while no other worker is idle (default 4)
+///     --algorithm NAME    algorithm for requests that do not name one (default bfs)
+///     --threads N         threads for each parallel search (default 1)
+///     --db FILE           distance database for the db algorithm; repeat for
+///                         several layouts
+///     --max-seconds S, --max-nodes N, --max-mb MB
+///                         budget for every search, as for the batch CLI
+///     --keep-mb MB        search memory a worker keeps between requests
+///                         (default 64)
+/// A request is a header line "id [algorithm]" followed by the board in the
+/// puzzle file format; blank lines and lines starting with # between requests
+/// are skipped. Each response is one JSON line carrying the request's id, so
+/// responses may arrive in any order: the status, the solution as moves
+/// ("7U" is one cell up, "4RD" two cells right then down), states expanded,
+/// peak search memory, and the time spent queued, solving and in total.
+/// Stdin mode exits once its input ends and every request is answered; socket
+/// mode runs until SIGINT or SIGTERM, then answers what it has read.
+/// </summary>
+/// <returns>int: 0 once stopped, EXIT_USAGE for a bad command line or socket</returns>
+int runServer(int argc, char* argv[])
+{
+    huarong::solveRequest defaults;
+    string socketPath;
+    vector<string> databaseFiles;
+    int workers = 0;
+    size_t batch = 4;
+    size_t keepBytes = size_t(64) << 20;
+
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--help" || arg == "-h") {
+            cout << "usage: Huarong --serve [--socket PATH] [--workers N] [--batch N] [--algorithm NAME] [--threads N] [--db FILE] [--max-seconds S] [--max-nodes N] [--max-mb MB] [--keep-mb MB]" << endl;
+            cout << "request: a line \"id [algorithm]\", then the board's " << BOARD_ROWS << " rows" << endl;
+            return 0;
+        }
+        else if (arg == "--socket" && hasValue)
+            socketPath = argv[++i];
+        else if (arg == "--workers" && hasValue)
+            workers = atoi(argv[++i]);
+        else if (arg == "--batch" && hasValue)
+            batch = size_t(max(atoi(argv[++i]), 1));
+        else if (arg == "--algorithm" && hasValue)
+            defaults.algorithm = argv[++i];
+        else if (arg == "--threads" && hasValue)
+            defaults.threads = atoi(argv[++i]);
+        else if (arg == "--db" && hasValue)
+            databaseFiles.push_back(argv[++i]);
+        else if (arg == "--max-seconds" && hasValue)
+            defaults.maxSeconds = atof(argv[++i]);
+        else if (arg == "--max-nodes" && hasValue)
+            defaults.maxExpanded = atol(argv[++i]);
+        else if (arg == "--max-mb" && hasValue)
+            defaults.maxBytes = size_t(strtoull(argv[++i], NULL, 10)) * 1024 * 1024;
+        else if (arg == "--keep-mb" && hasValue)
+            keepBytes = size_t(strtoull(argv[++i], NULL, 10)) * 1024 * 1024;
+        else {
+            cerr << "Unknown or incomplete option: " << arg << endl;
+            return EXIT_USAGE;
         }
     }
-    // Down
-    else if (position == "down") {
-        if (blank1.rowCord == 4 || blank2.rowCord == 4)
-            return 0;
-
-        if (adjacentOrientation == "horizontal") {
-            char p1ID = board[blank1.rowCord + 1][blank1.colCord];
-            char p2ID = board[blank2.rowCord + 1][blank2.colCord];
-
-            if ((p1ID == p2ID && p1ID != '0') || (checkPiece(board, p1ID) == "square" && checkPiece(board, p2ID) == "square")) {
-                temp[blank1.rowCord + 1][blank1.colCord] = 'b';
-                temp[blank2.rowCord + 1][blank2.colCord] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
-            }
-            else if (checkPiece(board, p1ID) == "vertical" && checkPiece(board, p2ID) == "vertical") {
-                temp[blank1.rowCord + 2][blank1.colCord] = 'b';
-                temp[blank2.rowCord + 2][blank2.colCord] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
-            }
-            else if (checkPiece(board, p1ID) == "king" && checkPiece(board, p2ID) == "king") {
-                temp[blank1.rowCord + 2][blank1.colCord] = 'b';
-                temp[blank2.rowCord + 2][blank2.colCord] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
-            }
-            else
-                return 0;
-        }
-        else if (adjacentOrientation == "vertical") {
-            if (blank1.rowCord + 2 > 4 || blank2.rowCord + 2 > 4) {
-                char p1ID = board[blank2.rowCord + 1][blank2.colCord];
-                if (checkPiece(board, p1ID) == "square") {
-                    temp[blank2.rowCord + 1][blank2.colCord] = 'b';
-                    temp[blank1.rowCord][blank1.colCord] = p1ID;
-                    return 1;
-                }
-                else
-                    return 0;
-            }
 
-            char p1ID = board[blank2.rowCord + 1][blank2.colCord];
-            char p2ID = board[blank2.rowCord + 2][blank2.colCord];
+    vector<string> names = huarong::solver::algorithms();
+    if (find(names.begin(), names.end(), defaults.algorithm) == names.end()) {
+        cerr << "Unknown algorithm: " << defaults.algorithm << endl;
+        return EXIT_USAGE;
+    }
 
-            if (p1ID == '0' || p2ID == '0')
-                return 0;
+    huarong::solver solver;
+    for (size_t d = 0; d < databaseFiles.size(); d++) {
+        string error;
+        if (!solver.loadDatabase(databaseFiles[d], error)) {
+            cerr << error << endl;
+            return EXIT_USAGE;
+        }
+    }
 
-            if (p1ID == p2ID) {
-                temp[blank2.rowCord + 1][blank2.colCord] = 'b';
-                temp[blank2.rowCord + 2][blank2.colCord] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
+    serverQueue queue(batch, size_t(threadCount(workers)));
+
+    // Splits one client's input into requests. A board cut short, by the end
+    // of the input or by a line that is not a board row, gets an error response
+    // like any board parseBoard rejects; such a line starts the next request.
+    auto readRequests = [&](const function<bool(string&)>& nextLine, const shared_ptr<serverConnection>& connection) {
+        string line;
+        bool carried = false;
+        while (carried || nextLine(line)) {
+            carried = false;
+            istringstream header(line);
+            string id, algorithm;
+            if (!(header >> id) || id[0] == '#')
+                continue;
+
+            serverRequest pending;
+            pending.id = id;
+            pending.request = defaults;
+            if (header >> algorithm)
+                pending.request.algorithm = algorithm;
+            for (int rows = 0; rows < BOARD_ROWS && nextLine(line); ) {
+                istringstream cells(line);
+                string cell;
+                int count = 0;
+                while (cells >> cell)
+                    count++;
+                if (count == 0)
+                    continue;
+                if (count != BOARD_COLS) {
+                    carried = true;
+                    break;
+                }
+                pending.request.board += line + '\n';
+                rows++;
             }
-            else if (checkPiece(board, p1ID) == "square")
-            {
-                temp[blank2.rowCord + 1][blank2.colCord] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                return 1;
+            pending.connection = connection;
+            pending.arrived = chrono::steady_clock::now();
+
+            // A board that does not parse is answered here, never queued
+            gameState board;
+            istringstream text(pending.request.board);
+            huarong::solveResult rejected;
+            if (!parseBoard(text, board, rejected.error)) {
+                rejected.status = "error";
+                connection->send(serverResponse(pending, rejected, pending.arrived));
+                continue;
             }
-            else
-                return 0;
+            queue.push(move(pending));
         }
+    };
+
+    thread listener;
+    if (socketPath.empty()) {
+        listener = thread([&] {
+            readRequests([](string& line) { return bool(getline(cin, line)); }, make_shared<serverConnection>());
+            queue.close();
+        });
     }
-    // Left
-    if (position == "left") {
-        if (blank1.colCord == 0 || blank2.colCord == 0)
-            return 0;
+    else {
+#ifdef _WIN32
+        cerr << "--socket is not supported on Windows; requests are read from stdin" << endl;
+        return EXIT_USAGE;
+#else
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path)) {
+            cerr << "Socket path too long: " << socketPath << endl;
+            return EXIT_USAGE;
+        }
+        memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+        int listening = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socketPath.c_str());
+        if (listening < 0 || ::bind(listening, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listening, 64) != 0) {
+            cerr << "Cannot listen on " << socketPath << ": " << strerror(errno) << endl;
+            if (listening >= 0)
+                close(listening);
+            return EXIT_USAGE;
+        }
 
-        if (adjacentOrientation == "vertical") {
-            char p1ID = board[blank1.rowCord][blank1.colCord - 1];
-            char p2ID = board[blank2.rowCord][blank2.colCord - 1];
-
-            if ((p1ID == p2ID && p1ID != '0') || (checkPiece(board, p1ID) == "square" && checkPiece(board, p2ID) == "square")) {
-                temp[blank1.rowCord][blank1.colCord - 1] = 'b';
-                temp[blank2.rowCord][blank2.colCord - 1] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
-            }
-            else if (checkPiece(board, p1ID) == "horizontal" && checkPiece(board, p2ID) == "horizontal") {
-                temp[blank1.rowCord][blank1.colCord - 2] = 'b';
-                temp[blank2.rowCord][blank2.colCord - 2] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
-            }
-            else if (checkPiece(board, p1ID) == "king" && checkPiece(board, p2ID) == "king") {
-                temp[blank1.rowCord][blank1.colCord - 2] = 'b';
-                temp[blank2.rowCord][blank2.colCord - 2] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
-            }
-            else
-                return 0;
-        }
-        else if (adjacentOrientation == "horizontal") {
-            if (blank1.colCord - 2 < 0 || blank2.colCord - 2 < 0) {
-                char p1ID = board[blank1.rowCord][blank1.colCord - 1];
-                if (checkPiece(board, p1ID) == "square") {
-                    temp[blank1.rowCord][blank1.colCord - 1] = 'b';
-                    temp[blank2.rowCord][blank2.colCord] = p1ID;
-                    return 1;
+        // A client that disconnects before its responses are written must not end the daemon
+        signal(SIGPIPE, SIG_IGN);
+        signal(SIGINT, [](int) { serverStopping = true; });
+        signal(SIGTERM, [](int) { serverStopping = true; });
+
+        listener = thread([&, listening] {
+            struct client
+            {
+                shared_ptr<serverConnection> connection;
+                shared_ptr<atomic<bool>> finished;
+                thread reader;
+            };
+            list<client> clients;
+
+            while (!serverStopping) {
+                pollfd waiting = { listening, POLLIN, 0 };
+                if (poll(&waiting, 1, 200) > 0) {
+                    int fd = accept(listening, NULL, NULL);
+                    if (fd >= 0) {
+                        client accepted = { make_shared<serverConnection>(fd), make_shared<atomic<bool>>(false), thread() };
+                        accepted.reader = thread([&readRequests, connection = accepted.connection, finished = accepted.finished] {
+                            vector<char> buffer;
+                            size_t start = 0;
+                            readRequests([&](string& line) {
+                                for (;;) {
+                                    auto end = find(buffer.begin() + start, buffer.end(), '\n');
+                                    if (end != buffer.end()) {
+                                        line.assign(buffer.begin() + start, end);
+                                        start = size_t(end - buffer.begin()) + 1;
+                                        return true;
+                                    }
+                                    buffer.erase(buffer.begin(), buffer.begin() + start);
+                                    start = 0;
+                                    char chunk[4096];
+                                    ssize_t got = read(connection->descriptor(), chunk, sizeof(chunk));
+                                    if (got <= 0) {
+                                        line.assign(buffer.begin(), buffer.end());
+                                        buffer.clear();
+                                        return !line.empty();
+                                    }
+                                    buffer.insert(buffer.end(), chunk, chunk + got);
+                                }
+                            }, connection);
+                            *finished = true;
+                        });
+                        clients.push_back(move(accepted));
+                    }
+                }
+
+                // Readers whose clients have hung up are joined as the daemon goes
+                for (auto c = clients.begin(); c != clients.end(); ) {
+                    if (*c->finished) {
+                        c->reader.join();
+                        c = clients.erase(c);
+                    }
+                    else
+                        ++c;
                 }
-                else
-                    return 0;
             }
-            char p1ID = board[blank1.rowCord][blank1.colCord - 2];
-            char p2ID = board[blank1.rowCord][blank1.colCord - 1];
 
-            if (p1ID == '0' || p2ID == '0')
-                return 0;
+            // Stop reading from every client, but keep their sockets open for the answers still owed
+            close(listening);
+            unlink(socketPath.c_str());
+            for (auto c = clients.begin(); c != clients.end(); ++c) {
+                shutdown(c->connection->descriptor(), SHUT_RD);
+                c->reader.join();
+            }
+            queue.close();
+        });
+#endif
+    }
 
-            if (p1ID == p2ID) {
-                temp[blank1.rowCord][blank1.colCord - 2] = 'b';
-                temp[blank1.rowCord][blank1.colCord - 1] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
+    workerPool pool(threadCount(workers));
+    pool.run([&](int) {
+        huarong::workspace scratch(keepBytes);
+        vector<serverRequest> taken;
+        while (queue.take(taken)) {
+            for (size_t r = 0; r < taken.size(); r++) {
+                serverRequest& pending = taken[r];
+                auto started = chrono::steady_clock::now();
+                huarong::solveResult result = solver.solve(pending.request, scratch);
+                pending.connection->send(serverResponse(pending, result, started));
+                pending.connection.reset();
             }
-            else if (checkPiece(board, p2ID) == "square")
-            {
-                temp[blank1.rowCord][blank1.colCord - 1] = 'b';
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
+        }
+    });
+    listener.join();
+    return 0;
+}
+
+/// <summary>
+/// Benchmark suite: every algorithm on every bundled puzzle, with warmup runs
+/// and repeated timed trials.
+///   Huarong --bench [options]
+///     --algorithm NAME    benchmark only NAME; repeat for several (default all)
+///     --puzzle NAME       benchmark only inputs/NAME.in; repeat for several
+///                         (default BUNDLED_PUZZLES)
+///     --inputs DIR        puzzle directory (default inputs)
+///     --trials N          timed runs per case (default 5)
+///     --warmup N          untimed runs before them (default 1)
+///     --threads N         threads for the parallel searches (default one per core)
+///     --csv FILE          also write the results as CSV, the format --baseline reads
+///     --baseline FILE     compare with an earlier --csv file: solution lengths
+///                         must match, and expansion counts for serial searches
+///     --tolerance PCT     also fail when a median time is more than PCT percent
+///                         over its baseline (default 0, times not checked)
+/// Prints one JSON record per case as it finishes: median and p95 wall time,
+/// nodes expanded per second, peak resident memory and solution length.
+/// Distance databases for the db walk are built before timing starts.
+/// </summary>
+/// <returns>int: 0 if every case ran and matched its baseline, EXIT_REGRESSION
+/// if one did not, EXIT_PUZZLE_ERROR if a case failed, EXIT_USAGE for a bad command line</returns>
+int runBenchmark(int argc, char* argv[])
+{
+    vector<const searchAlgorithm*> algorithms;
+    vector<string> puzzles;
+    string inputs = "inputs";
+    int trials = 5;
+    int warmup = 1;
+    searchOptions options;
+    string csvFile;
+    string baselineFile;
+    double tolerance = 0;
+
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--help" || arg == "-h") {
+            cout << "usage: Huarong --bench [--algorithm NAME] [--puzzle NAME] [--inputs DIR] [--trials N] [--warmup N] [--threads N]" << endl;
+            cout << "                       [--csv FILE] [--baseline FILE] [--tolerance PCT]" << endl;
+            return 0;
+        }
+        else if (arg == "--algorithm" && hasValue) {
+            string name = argv[++i];
+            int a = 0;
+            while (a < ALGORITHM_COUNT && name != SEARCH_ALGORITHMS[a].name)
+                a++;
+            if (a == ALGORITHM_COUNT) {
+                cerr << "Unknown algorithm: " << name << endl;
+                return EXIT_USAGE;
             }
-            else
-                return 0;
+            algorithms.push_back(&SEARCH_ALGORITHMS[a]);
+        }
+        else if (arg == "--puzzle" && hasValue)
+            puzzles.push_back(argv[++i]);
+        else if (arg == "--inputs" && hasValue)
+            inputs = argv[++i];
+        else if (arg == "--trials" && hasValue)
+            trials = max(1, atoi(argv[++i]));
+        else if (arg == "--warmup" && hasValue)
+            warmup = max(0, atoi(argv[++i]));
+        else if (arg == "--threads" && hasValue)
+            options.threads = atoi(argv[++i]);
+        else if (arg == "--csv" && hasValue)
+            csvFile = argv[++i];
+        else if (arg == "--baseline" && hasValue)
+            baselineFile = argv[++i];
+        else if (arg == "--tolerance" && hasValue)
+            tolerance = atof(argv[++i]);
+        else {
+            cerr << "Unknown or incomplete option: " << arg << endl;
+            return EXIT_USAGE;
+        }
+    }
+    if (algorithms.empty()) {
+        for (int a = 0; a < ALGORITHM_COUNT; a++)
+            algorithms.push_back(&SEARCH_ALGORITHMS[a]);
+    }
+    if (puzzles.empty())
+        puzzles.assign(BUNDLED_PUZZLES, BUNDLED_PUZZLES + sizeof(BUNDLED_PUZZLES) / sizeof(BUNDLED_PUZZLES[0]));
+
+    const char* COLUMNS[] = { "algorithm", "puzzle", "trials", "steps", "expanded", "median_ms", "p95_ms", "nodes_per_sec", "peak_rss_kb", "peak_kb" };
+    const size_t COLUMN_COUNT = sizeof(COLUMNS) / sizeof(COLUMNS[0]);
+
+    // Baseline rows by "algorithm,puzzle", each a map from column name to value
+    map<string, map<string, string>> baseline;
+    if (!baselineFile.empty()) {
+        ifstream in(baselineFile);
+        string line;
+        vector<string> header;
+        if (!in.is_open() || !getline(in, line)) {
+            cerr << "Cannot read baseline: " << baselineFile << endl;
+            return EXIT_USAGE;
+        }
+        for (istringstream cells(line); getline(cells, line, ',');)
+            header.push_back(line);
+        while (getline(in, line)) {
+            map<string, string> row;
+            istringstream cells(line);
+            string cell;
+            for (size_t c = 0; c < header.size() && getline(cells, cell, ','); c++)
+                row[header[c]] = cell;
+            if (row.count("algorithm") && row.count("puzzle"))
+                baseline[row["algorithm"] + "," + row["puzzle"]] = row;
         }
     }
-    // Right
-    if (position == "right") {
-        if (blank1.colCord == 3 || blank2.colCord == 3)
-            return 0;
 
-        if (adjacentOrientation == "vertical") {
-            char p1ID = board[blank1.rowCord][blank1.colCord + 1];
-            char p2ID = board[blank2.rowCord][blank2.colCord + 1];
-
-            if ((p1ID == p2ID && p1ID != '0') || (checkPiece(board, p1ID) == "square" && checkPiece(board, p2ID) == "square")) {
-                temp[blank1.rowCord][blank1.colCord + 1] = 'b';
-                temp[blank2.rowCord][blank2.colCord + 1] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
-            }
-            else if (checkPiece(board, p1ID) == "horizontal" && checkPiece(board, p2ID) == "horizontal") {
-                temp[blank1.rowCord][blank1.colCord + 2] = 'b';
-                temp[blank2.rowCord][blank2.colCord + 2] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
-            }
-            else if (checkPiece(board, p1ID) == "king" && checkPiece(board, p2ID) == "king") {
-                temp[blank1.rowCord][blank1.colCord + 2] = 'b';
-                temp[blank2.rowCord][blank2.colCord + 2] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
-            }
-            else
-                return 0;
-        }
-        else if (adjacentOrientation == "horizontal") {
-            if (blank1.colCord + 2 > 3 || blank2.colCord + 2 > 3) {
-                char p1ID = board[blank2.rowCord][blank2.colCord + 1];
-                if (checkPiece(board, p1ID) == "square") {
-                    temp[blank2.rowCord][blank2.colCord + 1] = 'b';
-                    temp[blank1.rowCord][blank1.colCord] = p1ID;
-                    return 1;
-                }
-                else
-                    return 0;
+    vector<gameState> boards;
+    for (size_t p = 0; p < puzzles.size(); p++) {
+        gameState board;
+        string error;
+        if (!loadBoard(inputs + "/" + puzzles[p] + ".in", board, error)) {
+            cerr << inputs << "/" << puzzles[p] << ".in: " << error << endl;
+            return EXIT_USAGE;
+        }
+        boards.push_back(board);
+    }
+
+    // One database per piece inventory, built before anything is timed
+    vector<unique_ptr<distanceDatabase>> databases;
+    for (size_t a = 0; a < algorithms.size(); a++) {
+        if (!algorithms[a]->database)
+            continue;
+        for (size_t p = 0; p < boards.size(); p++) {
+            uint8_t inventory[4];
+            pieceInventory(boards[p].pieces, inventory);
+            bool covered = false;
+            for (size_t d = 0; d < databases.size(); d++)
+                covered = covered || databases[d]->covers(inventory);
+            if (covered)
+                continue;
+            string error;
+            databases.push_back(unique_ptr<distanceDatabase>(new distanceDatabase()));
+            if (!buildDistanceDatabase(boards[p], *databases.back(), error)) {
+                cerr << puzzles[p] << ": " << error << endl;
+                return EXIT_PUZZLE_ERROR;
             }
-            char p1ID = board[blank2.rowCord][blank2.colCord + 1];
-            char p2ID = board[blank2.rowCord][blank2.colCord + 2];
+            options.databases.push_back(databases.back().get());
+        }
+        break;
+    }
+
+    ofstream csv;
+    if (!csvFile.empty()) {
+        csv.open(csvFile, ios::trunc);
+        if (!csv.is_open()) {
+            cerr << "Cannot write " << csvFile << endl;
+            return EXIT_USAGE;
+        }
+        for (size_t c = 0; c < COLUMN_COUNT; c++)
+            csv << (c ? "," : "") << COLUMNS[c];
+        csv << endl;
+    }
 
-            if (p1ID == '0' || p2ID == '0')
-                return 0;
+    int status = 0;
+    for (size_t a = 0; a < algorithms.size(); a++) {
+        const searchAlgorithm& algorithm = *algorithms[a];
+        for (size_t p = 0; p < boards.size(); p++) {
+            searchResult result;
+            vector<double> times;
+            resetPeakResident();
+            for (int t = 0; t < warmup + trials && result.error.empty(); t++) {
+                auto start = chrono::steady_clock::now();
+                result = runSearch(algorithm, boards[p], options);
+                double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                if (t >= warmup)
+                    times.push_back(ms);
+            }
 
-            if (p1ID == p2ID) {
-                temp[blank2.rowCord][blank2.colCord + 2] = 'b';
-                temp[blank2.rowCord][blank2.colCord + 1] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                temp[blank2.rowCord][blank2.colCord] = p2ID;
-                return 1;
+            ostringstream record;
+            record << "{\"algorithm\":\"" << algorithm.name << "\",\"puzzle\":" << jsonString(puzzles[p]);
+            if (!result.error.empty() || !result.solved) {
+                record << ",\"status\":\"error\",\"error\":" << jsonString(result.error.empty() ? "no solution" : result.error) << "}";
+                cout << record.str() << endl;
+                status = status ? status : EXIT_PUZZLE_ERROR;
+                continue;
             }
-            else if (checkPiece(board, p1ID) == "square")
-            {
-                temp[blank2.rowCord][blank2.colCord + 1] = 'b';
-                temp[blank1.rowCord][blank1.colCord] = p1ID;
-                return 1;
+
+            // Nearest-rank percentiles over the timed trials
+            sort(times.begin(), times.end());
+            double median = times.size() % 2 ? times[times.size() / 2] : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+            double p95 = times[size_t(ceil(0.95 * times.size())) - 1];
+            double nodesPerSec = median > 0 ? result.expanded / (median / 1000) : 0;
+
+            ostringstream row;
+            row << algorithm.name << "," << puzzles[p] << "," << trials << "," << result.path.steps() << "," << result.expanded
+                << "," << median << "," << p95 << "," << size_t(nodesPerSec) << "," << peakResidentBytes() / 1024
+                << "," << result.peakBytes / 1024;
+            if (csv.is_open())
+                csv << row.str() << endl;
+
+            // Compare with the baseline. Parallel searches expand a different
+            // number of states from run to run, and a parallel DFS finds a
+            // different path, so only what is reproducible is compared.
+            string check = "ok";
+            auto found = baseline.find(string(algorithm.name) + "," + puzzles[p]);
+            if (baselineFile.empty())
+                check = "";
+            else if (found == baseline.end())
+                check = "not in baseline";
+            else {
+                map<string, string>& base = found->second;
+                if ((algorithm.optimal || !algorithm.parallel) && base["steps"] != to_string(result.path.steps()))
+                    check = "steps " + to_string(result.path.steps()) + ", baseline " + base["steps"];
+                else if (!algorithm.parallel && base["expanded"] != to_string(result.expanded))
+                    check = "expanded " + to_string(result.expanded) + ", baseline " + base["expanded"];
+                else if (tolerance > 0 && median > atof(base["median_ms"].c_str()) * (1 + tolerance / 100))
+                    check = "median " + to_string(median) + " ms, baseline " + base["median_ms"] + " ms";
+                if (check != "ok")
+                    status = EXIT_REGRESSION;
             }
-            else
-                return 0;
+
+            record << ",\"status\":\"solved\",\"steps\":" << result.path.steps() << ",\"expanded\":" << result.expanded
+                << ",\"trials\":" << trials << ",\"median_ms\":" << median << ",\"p95_ms\":" << p95
+                << ",\"nodes_per_sec\":" << size_t(nodesPerSec) << ",\"peak_rss_kb\":" << peakResidentBytes() / 1024
+                << ",\"peak_kb\":" << result.peakBytes / 1024;
+            if (!check.empty())
+                record << ",\"baseline\":" << jsonString(check);
+            record << "}";
+            cout << record.str() << endl;
         }
     }
-    return 0;
+
+    return status;
 }
 
 /// <summary>
-/// Populates global variables with coordinates of blank squares,
-/// and if/how the blank squares are adjacent
+/// Micro-benchmarks of the per-node kernels: move generation, board hashing,
+/// the visited table and the rest of what a search does for every state. Each
+/// kernel runs over a fixed corpus of states sampled from the bundled puzzles'
+/// state spaces, repeated until it has run for the minimum time.
+///   Huarong --microbench [options]
+///     --kernel NAME       run only NAME; repeat for several (default all)
+///     --samples N         states sampled from each puzzle (default 2048)
+///     --min-ms N          minimum time per kernel (default 200)
+///     --inputs DIR        puzzle directory (default inputs)
+///     --csv FILE          also write the results as CSV
+/// Prints one JSON record per kernel with ns/op and, in the HuarongMicrobench
+/// build, heap allocations/op. The checksum keeps the compiler from dropping
+/// the work and should not change between builds.
 /// </summary>
-/// <param name="board">The board to search for the location of blank squares</param>
-void findBlanks(vector<vector<char>> board)
+/// <returns>int: 0, or EXIT_USAGE for a bad command line</returns>
+int runMicrobenchmarks(int argc, char* argv[])
 {
-    int firstFound = 0;
-
-    // Find Blank Coordinates
-    for (int i = 0; i < board.size(); i++) {
-        for (int j = 0; j < board[i].size(); j++) {
-            if (board[i][j] == 'b') {
-                if (!firstFound) {
-                    blank1.rowCord = i;
-                    blank1.colCord = j;
-                    firstFound = 1;
-                }
-                else {
-                    blank2.rowCord = i;
-                    blank2.colCord = j;
-                }
+    // What every kernel works on: sampled states, one legal move and one piece
+    // of each, their keys, and a visited table that the table kernels fill
+    struct microCorpus
+    {
+        vector<gameState> states;
+        vector<uint8_t> moves;
+        vector<char> pieces;
+        vector<uint64_t> keys;
+        unique_ptr<visitedTable> table;
+    };
+
+    struct microKernel
+    {
+        const char* name;
+        uint64_t (*pass)(microCorpus& corpus);     // one op per state, returns a checksum
+    };
+
+    const microKernel KERNELS[] = {
+        { "blankMask", [](microCorpus& c) {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < c.states.size(); i++)
+                sum += blankMask(c.states[i].board);
+            return sum;
+        } },
+        { "generateSuccessors", [](microCorpus& c) {
+            uint64_t sum = 0;
+            successor successors[MAX_SUCCESSORS];
+            for (size_t i = 0; i < c.states.size(); i++) {
+                int count = generateSuccessors(c.states[i], successors);
+                sum += count + successors[count - 1].state.board.word[0];
             }
+            return sum;
+        } },
+        { "applyMove", [](microCorpus& c) {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < c.states.size(); i++) {
+                gameState next = c.states[i];
+                sum += applyMove(next, c.moves[i]) + next.board.word[1];
+            }
+            return sum;
+        } },
+        { "checkPiece", [](microCorpus& c) {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < c.states.size(); i++)
+                sum += checkPiece(c.states[i].pieces, c.pieces[i]);
+            return sum;
+        } },
+        { "boardState", [](microCorpus& c) {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < c.states.size(); i++)
+                sum += boardState(c.states[i].board)[i % 20];
+            return sum;
+        } },
+        { "canonicalKey", [](microCorpus& c) {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < c.states.size(); i++)
+                sum += canonicalKey(c.states[i].board);
+            return sum;
+        } },
+        { "hashKey", [](microCorpus& c) {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < c.keys.size(); i++)
+                sum += hashKey(c.keys[i]);
+            return sum;
+        } },
+        { "heuristic", [](microCorpus& c) {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < c.states.size(); i++)
+                sum += heuristic(c.states[i]);
+            return sum;
+        } },
+        { "visitedTable.insert", [](microCorpus& c) {
+            // A fresh table each pass, sized so it does not grow while timed
+            c.table.reset(new visitedTable(c.keys.size()));
+            uint64_t sum = 0;
+            for (size_t i = 0; i < c.keys.size(); i++)
+                sum += c.table->insert(c.keys[i]);
+            return sum;
+        } },
+        { "visitedTable.contains", [](microCorpus& c) {
+            if (!c.table) {
+                c.table.reset(new visitedTable(c.keys.size()));
+                for (size_t i = 0; i < c.keys.size(); i++)
+                    c.table->insert(c.keys[i]);
+            }
+            uint64_t sum = 0;
+            for (size_t i = 0; i < c.keys.size(); i++)
+                sum += c.table->contains(c.keys[i] ^ (i & 1));
+            return sum;
+        } },
+    };
+    const int KERNEL_COUNT = int(sizeof(KERNELS) / sizeof(KERNELS[0]));
+
+    vector<string> only;
+    size_t samples = 2048;
+    double minMs = 200;
+    string inputs = "inputs";
+    string csvFile;
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--help" || arg == "-h") {
+            cout << "usage: Huarong --microbench [--kernel NAME] [--samples N] [--min-ms N] [--inputs DIR] [--csv FILE]" << endl;
+            cout << "kernels:";
+            for (int k = 0; k < KERNEL_COUNT; k++)
+                cout << " " << KERNELS[k].name;
+            cout << endl;
+            return 0;
+        }
+        else if (arg == "--kernel" && hasValue)
+            only.push_back(argv[++i]);
+        else if (arg == "--samples" && hasValue)
+            samples = max(1, atoi(argv[++i]));
+        else if (arg == "--min-ms" && hasValue)
+            minMs = atof(argv[++i]);
+        else if (arg == "--inputs" && hasValue)
+            inputs = argv[++i];
+        else if (arg == "--csv" && hasValue)
+            csvFile = argv[++i];
+        else {
+            cerr << "Unknown or incomplete option: " << arg << endl;
+            return EXIT_USAGE;
+        }
+    }
+    for (size_t o = 0; o < only.size(); o++) {
+        int k = 0;
+        while (k < KERNEL_COUNT && only[o] != KERNELS[k].name)
+            k++;
+        if (k == KERNEL_COUNT) {
+            cerr << "Unknown kernel: " << only[o] << endl;
+            return EXIT_USAGE;
         }
     }
 
-    // Determine if adjacent
-    if (blank1.rowCord - 1 == blank2.rowCord || blank1.rowCord + 1 == blank2.rowCord) {
-        if (blank1.colCord == blank2.colCord) {
-            blanksAdjacent = 1;
-            adjacentOrientation = "vertical";
+    microCorpus corpus;
+    for (size_t p = 0; p < sizeof(BUNDLED_PUZZLES) / sizeof(BUNDLED_PUZZLES[0]); p++) {
+        gameState board;
+        string error;
+        if (!loadBoard(inputs + "/" + BUNDLED_PUZZLES[p] + ".in", board, error)) {
+            cerr << inputs << "/" << BUNDLED_PUZZLES[p] << ".in: " << error << endl;
+            return EXIT_USAGE;
         }
-        else
-            blanksAdjacent = 0;
+        vector<gameState> sampled = sampleStates(board, samples);
+        corpus.states.insert(corpus.states.end(), sampled.begin(), sampled.end());
+    }
+    successor successors[MAX_SUCCESSORS];
+    for (size_t i = 0; i < corpus.states.size(); i++) {
+        int count = generateSuccessors(corpus.states[i], successors);
+        corpus.moves.push_back(successors[i % count].move());
+        corpus.pieces.push_back(successors[i % count].piece);
+        corpus.keys.push_back(canonicalKey(corpus.states[i].board));
     }
-    else if (blank1.colCord - 1 == blank2.colCord || blank1.colCord + 1 == blank2.colCord) {
-        if (blank1.rowCord == blank2.rowCord) {
-            blanksAdjacent = 1;
-            adjacentOrientation = "horizontal";
+
+    ofstream csv;
+    if (!csvFile.empty()) {
+        csv.open(csvFile, ios::trunc);
+        if (!csv.is_open()) {
+            cerr << "Cannot write " << csvFile << endl;
+            return EXIT_USAGE;
         }
-        else
-            blanksAdjacent = 0;
+        csv << "kernel,ops,ns_per_op,allocs_per_op" << endl;
     }
-    else
-        blanksAdjacent = 0;
-}
 
-void printsolution(node* n)
-{
-    cout << endl << "-------- SOLUTION FOUND --------" << endl << endl;
-    printBoard(n->board);
-    cout << endl;
+    for (int k = 0; k < KERNEL_COUNT; k++) {
+        if (!only.empty() && find(only.begin(), only.end(), string(KERNELS[k].name)) == only.end())
+            continue;
 
-    while (n->parent) {
-        n->parent->next = n;
-        n = n->parent;
+        // One untimed pass to warm caches and build what the kernel needs
+        uint64_t checksum = KERNELS[k].pass(corpus);
+        size_t passes = 0;
+        size_t allocations = allocationsSoFar();
+        double ms = 0;
+        auto start = chrono::steady_clock::now();
+        while (ms < minMs || passes == 0) {
+            checksum += KERNELS[k].pass(corpus);
+            passes++;
+            ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        }
+        allocations = allocationsSoFar() - allocations;
+
+        size_t ops = passes * corpus.states.size();
+        double nsPerOp = ms * 1e6 / ops;
+        ostringstream record;
+        record << "{\"kernel\":\"" << KERNELS[k].name << "\",\"ops\":" << ops << ",\"ns_per_op\":" << nsPerOp;
+        if (COUNTING_ALLOCATIONS)
+            record << ",\"allocs_per_op\":" << double(allocations) / ops;
+        record << ",\"checksum\":" << checksum << "}";
+        cout << record.str() << endl;
+        if (csv.is_open()) {
+            csv << KERNELS[k].name << "," << ops << "," << nsPerOp << ",";
+            if (COUNTING_ALLOCATIONS)
+                csv << double(allocations) / ops;
+            csv << endl;
+        }
     }
+    return 0;
+}
 
-    int count = -1;
-    while (n) {
-        count++;
-        n = n->next;
+/// <summary>
+/// Samples a puzzle's state space: a breadth-first walk from the start, of
+/// which every k-th state is kept, so the sample spans near and far states.
+/// The same puzzle always gives the same sample.
+/// </summary>
+/// <param name="startState">The puzzle's start state</param>
+/// <param name="count">How many states to keep</param>
+/// <returns>vector<gameState>: up to count states</returns>
+vector<gameState> sampleStates(const gameState& startState, size_t count)
+{
+    vector<gameState> reached(1, startState);
+    visitedTable close(EXPECTED_STATES);
+    close.insert(canonicalKey(startState.board));
+    successor successors[MAX_SUCCESSORS];
+    for (size_t next = 0; next < reached.size(); next++) {
+        int generated = generateSuccessors(reached[next], successors);
+        for (int i = 0; i < generated; i++) {
+            if (close.insert(canonicalKey(successors[i].state.board)))
+                reached.push_back(successors[i].state);
+        }
     }
 
-    cout << "This solution has " << count << " steps." << endl << endl;
+    vector<gameState> sample;
+    size_t stride = max(size_t(1), reached.size() / count);
+    for (size_t i = 0; i < reached.size() && sample.size() < count; i += stride)
+        sample.push_back(reached[i]);
+    return sample;
 }
 
 /// <summary>
-/// Describes the type of piece given a identifier (examples: '1', '2', '3')
+/// Starts a new peak resident-memory measurement, where the OS allows it. On
+/// Linux this resets the kernel's high-water mark; elsewhere the peak covers
+/// the whole process.
 /// </summary>
-/// <param name="board">The board to search against</param>
-/// <param name="identifier">character that represents the piece on the 2D playing board</param>
-/// <returns>string: description of the type of the piece</returns>
-string checkPiece(vector<vector<char>> board, char identifier)
+void resetPeakResident()
 {
-    if (identifier == 'b')
-        return "blank";
+#if defined(__linux__)
+    ofstream clear("/proc/self/clear_refs");
+    clear << "5";
+#endif
+}
 
-    if (identifier == '0')
-        return "king";
+/// <summary>
+/// Peak resident memory of the process since the last resetPeakResident
+/// </summary>
+/// <returns>size_t: bytes, 0 if the platform does not report it</returns>
+size_t peakResidentBytes()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#elif defined(__linux__)
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return size_t(atoll(line.c_str() + 6)) * 1024;
+    }
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return size_t(usage.ru_maxrss);
+#else
+    return size_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
 
-    int row = -1;
-    int col = -1;
+/// <summary>
+/// Gets input from user for name of the puzzle
+/// </summary>
+/// <returns>string: name of the puzzle</returns>
+string getPuzzle()
+{
+    string name;
+    cout << "Please enter name of the first puzzle." << endl;
+    cout << "Enter Q or Quit to terminate the program." << endl;
+    cin >> name;
+    return name;
+}
 
-    for (int i = 0; i < board.size(); i++) {
-        for (int j = 0; j < board[i].size(); j++) {
-            if (board[i][j] == identifier) {
-                row = i;
-                col = j;
-            }
+/// <summary>
+/// Prints the board in a 2D form
+/// </summary>
+/// <param name="board">Board to be printed</param>
+void printBoard(const packedBoard& board)
+{
+    for (int i = 0; i < BOARD_ROWS; i++) {
+        for (int j = 0; j < BOARD_COLS; j++) {
+            cout << board.at(i, j) << " ";
         }
+        cout << endl;
     }
+}
 
-    if (row == -1 or col == -1) {
-        cout << "ERROR -- checkPiece()" << endl;
-        return "error";
-    }
+/// <summary>
+/// Prints the final board of a solution and its length
+/// </summary>
+/// <param name="path">The solution</param>
+void printsolution(const solutionPath& path)
+{
+    solutionReplay replay(path);
+    while (replay.next()) {}
 
-    // Determine if adjacent
-    if (row - 1 >= 0 && board[row - 1][col] == identifier || row + 1 < 5 && board[row + 1][col] == identifier)
-        return "vertical";
-    if (col - 1 >= 0 && board[row][col - 1] == identifier || col + 1 < 4 && board[row][col + 1] == identifier)
-        return "horizontal";
-    else
-        return "square";
+    cout << endl << "-------- SOLUTION FOUND --------" << endl << endl;
+    printBoard(replay.state().board);
+    cout << endl;
+
+    cout << "This solution has " << path.steps() << " steps." << endl << endl;
 }
 
 /// <summary>
-/// Creates an output file showing the steps to finding the solution
+/// Interactive report for a finished search: the solution and its length, the
+/// search's counters, and the solution file
 /// </summary>
-/// <param name="name">The name of the puzzle</param>
-/// <param name="algorithm">The algorithm being used.</param>
-/// <param name="solution">The solution node</param>
-void createOutputFile(string name, string algorithm, node* solution)
+/// <param name="name">The name of the puzzle, used for the solution file</param>
+/// <param name="algorithm">The search that ran</param>
+/// <param name="result">What the search returned</param>
+void reportResult(const string& name, const searchAlgorithm& algorithm, const searchResult& result)
 {
-    
-    ofstream outFile;
-    outFile.open(name + algorithm + ".out");
-
-    while (solution->parent) {
-        solution->parent->next = solution;
-        solution = solution->parent;
-    }
-
-    int count = -1;
-    while (solution) {
-        count++;
-        solution = solution->next;
-        
-        if (solution) {
-            outFile << "Step: " << count << endl;
-            for (int i = 0; i < solution->board.size(); i++) {
-                for (int j = 0; j < solution->board[0].size(); j++) {
-                    if (solution->board[i][j] == 'b') {
-                        outFile << "  ";
-                    }
-                    else {
-                        outFile << solution->board[i][j] << " ";
-                    }
-                }
-                outFile << endl;
-            }
-        } 
-        else
-            outFile << "FINAL SOLUTION" << endl;
-        
-        outFile << endl;
+    if (!result.error.empty()) {
+        cout << "Search failed: " << result.error << endl;
+        return;
+    }
+
+    if (result.solved) {
+        printsolution(result.path);
+        createOutputFile(name, algorithm.tag, result.path);
     }
+    else if (result.limit != LIMIT_NONE) {
+        cout << "Search stopped: " << limitName(result.limit) << " limit exceeded." << endl;
+        cout << "Deepest depth reached: " << result.deepest << endl;
+        if (result.closestKing >= 0)
+            cout << "Closest the king came to the goal: " << result.closestKing << " moves" << endl;
+    }
+    else
+        cout << "No solution.\n";
 
-    outFile.close();
+    cout << "Total of: " << result.expanded << " nodes expanded." << endl;
+    cout << "Peak memory: " << result.peakBytes / 1024 << " KB" << endl;
+    cout << result.stats;
 }
 
 /// <summary>
-/// Breadth First Search to find a solution to the game board
+/// Final breakdown of an instrumented search: time, expansions and duplicates
+/// for each phase, and the frontier size at each depth for layered searches
 /// </summary>
-/// <param name="board">The board to run BFS against</param>
-void bfs(vector<vector<char>> board)
+/// <param name="progress">The search's counters, after it returned</param>
+string progressBreakdown(const searchProgress& progress)
 {
-    cout << "Running BFS....." << endl;
-    string moves[4] = { "up", "down", "left", "right" };
-    
-    queue<node*> open;
-    nodeP* np;
-    np = new nodeP[200000];
-    int npCount = 0;
-    set<string> close;
-    node *start, *current, *succ;
-    string sucnum;
-    start = new node(board);
-    vector<vector<char>> temp(5, vector<char>(4));
-    int success = 0;
-
-    open.push(start);
-    np[npCount++] = start;
-    close.insert(boardState(start->board));
-    long gencount = 1;
-
-    while (!open.empty() && !success)
-    {
-        current = open.front();
-        open.pop();
-        if (checkGoal(current->board))
-        {
-            printsolution(current);
-            cout << "Total of: " << gencount << " nodes examined." << endl;
-            createOutputFile(puzzleName, "BFS", current);
-            success = 1;
-        }
-        else
-        {
-            for (int i = 0; i < 4; i++) {
-                findBlanks(current->board);
-                if (makeSingleMove(current->board, temp, blank1, moves[i])) {
-                    sucnum = boardState(temp);
-                    if (close.find(sucnum) == close.end()) {
-                        succ = new node(temp, current);
-                        close.insert(sucnum);
-                        open.push(succ);
-                        np[npCount++] = succ;
-                        gencount++;
-                    }
-                    findBlanks(current->board);
-                }
-                if (makeSingleMove(current->board, temp, blank2, moves[i])) {
-                    sucnum = boardState(temp);
-                    if (close.find(sucnum) == close.end()) {
-                        succ = new node(temp, current);
-                        close.insert(sucnum);
-                        open.push(succ);
-                        np[npCount++] = succ;
-                        gencount++;
-                    }
-                    findBlanks(current->board);
-                }
-                if (blanksAdjacent) {
-                    if (makeDoubleMove(current->board, temp, moves[i])) {
-                        sucnum = boardState(temp);
-                        if (close.find(sucnum) == close.end()) {
-                            succ = new node(temp, current);
-                            close.insert(sucnum);
-                            open.push(succ);
-                            np[npCount++] = succ;
-                            gencount++;
-                        }
-                        findBlanks(current->board);
-                    }
-                }
-            }
-        }
+    ostringstream out;
+    vector<searchProgress::phase> phases = progress.phases();
+    for (size_t p = 0; p < phases.size(); p++) {
+        out << "Phase " << phases[p].name << ": " << phases[p].ms << " ms, " << phases[p].expanded << " expanded, "
+            << phases[p].duplicates << " duplicates" << endl;
     }
-
-    if (!success) {
-        cout << "No solution.\n";
-        cout << "Total of " << gencount
-            << " nodes examined.\n\n";
+    vector<size_t> layers = progress.layerSizes();
+    if (!layers.empty()) {
+        out << "Frontier by depth:";
+        for (size_t d = 0; d < layers.size(); d++)
+            out << " " << layers[d];
+        out << endl;
     }
+    return out.str();
+}
 
-    for (int j = 0; j < npCount; j++)
-        delete np[j];
-
-    delete[] np;
+/// <summary>
+/// Number of states reachable from a board, when a distance database for its
+/// pieces is loaded; used for the progress ETA
+/// </summary>
+/// <returns>size_t: the state count, or 0 if unknown</returns>
+size_t stateSpaceSize(const gameState& state, const searchOptions& options)
+{
+    uint8_t inventory[4];
+    pieceInventory(state.pieces, inventory);
+    for (size_t d = 0; d < options.databases.size(); d++) {
+        if (options.databases[d]->covers(inventory))
+            return options.databases[d]->size();
+    }
+    return 0;
+}
 
-    return;
+/// <summary>
+/// Puzzle name from a puzzle file path: the file name without directory or extension
+/// </summary>
+string puzzleStem(const string& file)
+{
+    size_t slash = file.find_last_of("/\\");
+    string stem = slash == string::npos ? file : file.substr(slash + 1);
+    size_t dot = stem.find_last_of('.');
+    return dot == string::npos ? stem : stem.substr(0, dot);
 }
 
 /// <summary>
-/// Depth First Search to find a solution to the game board
+/// Quotes a string for a JSON record
 /// </summary>
-/// <param name="board">The board to run DFS against</param>
-void dfs(vector<vector<char>> board)
+string jsonString(const string& text)
 {
-    cout << "Running DFS....." << endl;
-    string moves[4] = { "up", "down", "left", "right" };
-    
-    stack<node*> open;
-    nodeP* np;
-    np = new nodeP[200000];
-    int npCount = 0;
-    set<string> close;
-    node* start, * current, * succ;
-    string sucnum;
-    start = new node(board);
-    vector<vector<char>> temp(5, vector<char>(4));
-    int success = 0;
-
-    open.push(start);
-    np[npCount++] = start;
-    close.insert(boardState(start->board));
-    long gencount = 1;
-
-    while (!open.empty() && !success)
-    {
-        current = open.top();
-        open.pop();
-        if (checkGoal(current->board))
-        {
-            printsolution(current);
-            cout << "Total of: " << gencount << " nodes examined." << endl;
-            createOutputFile(puzzleName, "DFS", current);
-            success = 1;
+    ostringstream out;
+    out << '"';
+    for (size_t i = 0; i < text.size(); i++) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (c < 0x20) {
+            const char* hex = "0123456789abcdef";
+            out << "\\u00" << hex[c >> 4] << hex[c & 0xF];
         }
         else
-        {
-            for (int i = 0; i < 4; i++) {
-                findBlanks(current->board);
-                if (makeSingleMove(current->board, temp, blank1, moves[i])) {
-                    sucnum = boardState(temp);
-                    if (close.find(sucnum) == close.end()) {
-                        succ = new node(temp, current);
-                        close.insert(sucnum);
-                        open.push(succ);
-                        np[npCount++] = succ;
-                        gencount++;
-                    }
-                    findBlanks(current->board);
-                }
+            out << c;
+    }
+    out << '"';
+    return out.str();
+}
 
-                if (makeSingleMove(current->board, temp, blank2, moves[i])) {
-                    sucnum = boardState(temp);
-                    if (close.find(sucnum) == close.end()) {
-                        succ = new node(temp, current);
-                        close.insert(sucnum);
-                        open.push(succ);
-                        np[npCount++] = succ;
-                        gencount++;
-                    }
-                    findBlanks(current->board);
+/// <summary>
+/// Creates an output file showing the steps to finding the solution
+/// </summary>
+/// <param name="name">The name of the puzzle</param>
+/// <param name="algorithm">The algorithm being used.</param>
+/// <param name="path">The solution, replayed one board at a time as it is written</param>
+/// <param name="format">FORMAT_TEXT writes name + algorithm + ".out", FORMAT_DELTA ".delta"</param>
+/// <returns>bool: false if the file could not be written</returns>
+bool createOutputFile(string name, string algorithm, const solutionPath& path, outputFormat format)
+{
+    ofstream outFile(name + algorithm + (format == FORMAT_DELTA ? ".delta" : ".out"), ios::binary | ios::trunc);
+    return outFile.is_open() && writeSolution(outFile, path, format);
+}
+
+/// <summary>
+/// Streams a solution trace. The text format has a "Step: n" block with the
+/// board after each move, then "FINAL SOLUTION". The delta format starts with
+/// "DELTA 1" and the start board, then has one line per move: the step number
+/// and each changed cell as row, column and new contents ('b' for a blank),
+/// e.g. "0 30b 316" for a piece 6 stepping right from cell (3,0).
+/// </summary>
+/// <param name="out">File, stdout or pipe to write to</param>
+/// <param name="path">The solution, replayed one board at a time as it is written</param>
+/// <param name="format">outputFormat of the trace</param>
+/// <returns>bool: false if the stream failed</returns>
+bool writeSolution(ostream& out, const solutionPath& path, outputFormat format)
+{
+    outputBuffer buffer(out);
+    auto writeBoard = [&buffer](const packedBoard& board) {
+        for (int i = 0; i < BOARD_ROWS; i++) {
+            for (int j = 0; j < BOARD_COLS; j++) {
+                if (board.cell(i, j) == BLANK_CELL)
+                    buffer.append("  ", 2);
+                else {
+                    buffer.put(board.at(i, j));
+                    buffer.put(' ');
                 }
-                if (blanksAdjacent) {
-                    if (makeDoubleMove(current->board, temp, moves[i])) {
-                        sucnum = boardState(temp);
-                        if (close.find(sucnum) == close.end()) {
-                            succ = new node(temp, current);
-                            close.insert(sucnum);
-                            open.push(succ);
-                            np[npCount++] = succ;
-                            gencount++;
-                        }
-                        findBlanks(current->board);
+            }
+            buffer.put('\n');
+        }
+    };
+
+    solutionReplay replay(path);
+    if (format == FORMAT_DELTA) {
+        buffer.append("DELTA 1\n");
+        writeBoard(path.start.board);
+        buffer.put('\n');
+        for (packedBoard before = path.start.board; replay.next(); before = replay.state().board) {
+            const packedBoard& board = replay.state().board;
+            buffer.number(replay.step() - 1);
+            for (int i = 0; i < BOARD_ROWS; i++) {
+                for (int j = 0; j < BOARD_COLS; j++) {
+                    if (board.cell(i, j) != before.cell(i, j)) {
+                        buffer.put(' ');
+                        buffer.put(char('0' + i));
+                        buffer.put(char('0' + j));
+                        buffer.put(board.at(i, j));
                     }
                 }
             }
+            buffer.put('\n');
         }
+        buffer.append("FINAL SOLUTION\n");
     }
-
-    if (!success) {
-        cout << "No solution.\n";
-        cout << "Total of " << gencount
-            << " nodes examined.\n\n";
+    else {
+        while (replay.next()) {
+            buffer.append("Step: ");
+            buffer.number(replay.step() - 1);
+            buffer.put('\n');
+            writeBoard(replay.state().board);
+            buffer.put('\n');
+        }
+        buffer.append("FINAL SOLUTION\n\n");
     }
 
-    for (int j = 0; j < npCount; j++)
-        delete np[j];
+    buffer.flush();
+    out.flush();
+    return bool(out);
+}
 
-    delete[] np;
+/// <summary>
+/// Creates a binary solution file: the start board and the move list, for tools
+/// that replay solutions themselves. Native byte order:
+///   char magic[4]     "HRSL"
+///   uint32 version    1
+///   char board[20]    boardState() of the start, row by row, 'b' for blanks
+///   uint32 steps
+///   uint8 moves[steps], each piece id * 20 + first direction * 5 + second
+///                     direction (moveDirection, DIR_NONE for a one-cell move)
+/// </summary>
+/// <param name="name">The name of the puzzle</param>
+/// <param name="algorithm">The algorithm being used</param>
+/// <param name="path">The solution</param>
+/// <returns>bool: false if the file could not be written</returns>
+bool createSolutionFile(const string& name, const string& algorithm, const solutionPath& path)
+{
+    const uint32_t version = 1;
+    uint32_t steps = uint32_t(path.steps());
+    string board = boardState(path.start.board);
+
+    ofstream out(name + algorithm + ".sol", ios::binary | ios::trunc);
+    out.write("HRSL", 4);
+    out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    out.write(board.data(), streamsize(board.size()));
+    out.write(reinterpret_cast<const char*>(&steps), sizeof(steps));
+    out.write(reinterpret_cast<const char*>(path.moves.data()), streamsize(path.moves.size()));
+    return bool(out);
+}
 
-    return;
+/// <summary>
+/// Strong-scaling report: solves every bundled puzzle with the parallel BFS at
+/// 1, 2, 4, ... threads up to the core count and prints time, speedup and
+/// parallel efficiency against the single-threaded run
+/// </summary>
+void parallelScaling()
+{
+    vector<string> names;
+    vector<gameState> boards;
+    for (size_t i = 0; i < sizeof(BUNDLED_PUZZLES) / sizeof(BUNDLED_PUZZLES[0]); i++) {
+        gameState board;
+        string error;
+        if (!loadBoard("inputs/" + string(BUNDLED_PUZZLES[i]) + ".in", board, error))
+            continue;
+        names.push_back(BUNDLED_PUZZLES[i]);
+        boards.push_back(board);
+    }
+
+    int cores = threadCount(0);
+    vector<int> counts;
+    for (int t = 1; t < cores; t <<= 1)
+        counts.push_back(t);
+    counts.push_back(cores);
+
+    cout << "threads";
+    for (size_t i = 0; i < names.size(); i++)
+        cout << "\t" << names[i];
+    cout << "\ttotal ms\tspeedup\tefficiency" << endl;
+
+    double baseline = 0;
+    searchBudget unlimited((searchOptions()));
+    for (size_t c = 0; c < counts.size(); c++) {
+        workerPool pool(counts[c]);
+        double total = 0;
+        cout << counts[c];
+        for (size_t i = 0; i < boards.size(); i++) {
+            nodeArena arena;
+            long expanded = 0;
+            size_t explored = 0;
+            size_t tableBytes = 0;
+            auto start = chrono::steady_clock::now();
+            parallelBfsSearch(boards[i], pool, arena, expanded, explored, tableBytes, NULL, unlimited);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            total += ms;
+            cout << "\t" << ms;
+        }
+        if (c == 0)
+            baseline = total;
+        double speedup = total > 0 ? baseline / total : 0;
+        cout << "\t" << total << "\t" << speedup << "\t" << speedup / counts[c] << endl;
+    }
 }
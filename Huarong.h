@@ -0,0 +1,106 @@
+// Huarong.h
+// Embedding API for the Huarong Pass solver. A solver holds the distance
+// databases it was given; solve() takes a board, an algorithm and limits and
+// returns the move list and search statistics. solve() keeps all of its state
+// on the calling thread, so one solver may be shared by any number of threads.
+// Load databases before the first solve(): loadDatabase() is not thread safe.
+// A thread that solves many boards can pass its own workspace to keep search
+// memory allocated between calls.
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace huarong
+{
+    // One move of a solution: a piece slides one cell, or two cells along a
+    // straight or L-shaped path, in one step
+    struct solveMove
+    {
+        char piece;             // identifier on the board, '0'-'9'
+        char direction;         // 'U', 'D', 'L' or 'R'
+        char secondDirection;   // second cell of a two-cell slide, 0 for a one-cell slide
+    };
+
+    // Solve Request Struct
+    struct solveRequest
+    {
+        std::string board;              // puzzle file text: 5 rows of 4 cells, 'b' for blanks, '0' the king
+        std::string algorithm = "bfs";  // one of solver::algorithms()
+        int threads = 1;                // for the parallel searches, 0 for one per core
+        double maxSeconds = 0;          // wall-time budget, 0 for none
+        long maxExpanded = 0;           // states expanded, 0 for none
+        std::size_t maxBytes = 0;       // bytes held by the search, 0 for none
+    };
+
+    // Solve Result Struct
+    struct solveResult
+    {
+        std::string status;             // "solved", "unsolved", "limit" or "error"
+        std::string error;              // status error: what was wrong with the request
+        std::string limit;              // status limit: "time", "nodes" or "memory"
+        std::vector<solveMove> moves;   // status solved: the moves from the board to the goal
+        long expanded = 0;              // states expanded
+        std::size_t peakBytes = 0;      // largest footprint of the search's own structures
+        double ms = 0;                  // wall time of the search
+        int deepest = 0;                // status limit: deepest depth reached
+        int kingDistance = -1;          // status limit: fewest king moves to the goal seen, -1 if unknown
+    };
+
+    // Workspace Class
+    // Search memory kept between solves on one thread: the node arena and the
+    // visited table of the serial searches stay allocated, as long as they hold
+    // no more than keepBytes after a solve, so repeated small solves skip
+    // building them. Not thread safe: use one per thread.
+    class workspace
+    {
+        public:
+            explicit workspace(std::size_t keepBytes = std::size_t(64) << 20);
+            ~workspace();
+            workspace(const workspace&) = delete;
+            workspace& operator=(const workspace&) = delete;
+
+        private:
+            friend class solver;
+            struct state;
+            std::unique_ptr<state> held;
+    };
+
+    // Solver Class
+    class solver
+    {
+        public:
+            solver();
+            ~solver();
+            solver(const solver&) = delete;
+            solver& operator=(const solver&) = delete;
+
+            /// <summary>
+            /// Adds a distance database built with --build-db, for the "db" algorithm
+            /// </summary>
+            /// <returns>bool: false with error set if the file cannot be used</returns>
+            bool loadDatabase(const std::string& file, std::string& error);
+
+            /// <summary>
+            /// Solves one board. Safe to call from several threads at once.
+            /// </summary>
+            solveResult solve(const solveRequest& request) const;
+
+            /// <summary>
+            /// Solves one board reusing a workspace. Safe to call from several
+            /// threads at once, each with its own workspace.
+            /// </summary>
+            solveResult solve(const solveRequest& request, workspace& scratch) const;
+
+            // Names accepted in solveRequest::algorithm
+            static std::vector<std::string> algorithms();
+
+        private:
+            struct state;
+            std::unique_ptr<state> loaded;
+
+            solveResult run(const solveRequest& request, workspace* scratch) const;
+    };
+}
@@ -0,0 +1,2458 @@
+// Solver.cpp
+// The solver library: board handling, the move generator, every search and
+// the distance databases, plus the embedding API declared in Huarong.h.
+// Nothing here keeps mutable state between calls or writes to the console.
+#include "Solver.h"
+#include "Huarong.h"
+
+// Every search mode, in menu order
+const searchAlgorithm SEARCH_ALGORITHMS[] = {
+    { "dfs", "DFS", "Depth-first Search", false, false, false, dfs },
+    { "bfs", "BFS", "Breadth-First Search", false, false, true, bfs },
+    { "astar", "ASTAR", "A* Search", false, false, true, astar },
+    { "idastar", "IDASTAR", "Iterative Deepening A* Search", false, false, true, idastar },
+    { "bidir", "BIDIR", "Bidirectional Breadth-First Search", false, false, true, bidirectional },
+    { "pbfs", "PBFS", "Parallel Breadth-First Search", true, false, true, parallelBfs },
+    { "pdfs", "PDFS", "Parallel Depth-first Search (work stealing)", true, false, false, parallelDfs },
+    { "pidastar", "PIDASTAR", "Parallel Iterative Deepening A* Search (work stealing)", true, false, true, parallelIdastar },
+    { "db", "DB", "Distance database walk", false, true, true, databaseWalk },
+    { "ebfs", "EBFS", "External-memory Breadth-First Search", false, false, true, externalBfs },
+};
+const int ALGORITHM_COUNT = int(sizeof(SEARCH_ALGORITHMS) / sizeof(SEARCH_ALGORITHMS[0]));
+
+// Every variant geometry
+const boardVariant BOARD_VARIANTS[] = {
+    { "5x4", "5x4 board, classic pieces", solveVariant<classicGeometry> },
+    { "6x4", "6x4 board, classic pieces", solveVariant<boardGeometry<6, 4, classicShapes>> },
+    { "5x5", "5x5 board, classic pieces", solveVariant<boardGeometry<5, 5, classicShapes>> },
+    { "5x4-l", "5x4 board, classic and L-shaped pieces", solveVariant<boardGeometry<5, 4, extendedShapes>> },
+};
+const int VARIANT_COUNT = int(sizeof(BOARD_VARIANTS) / sizeof(BOARD_VARIANTS[0]));
+
+/// <summary>
+/// Builds the initial board state from a puzzle file
+/// </summary>
+/// <param name="file">path of the puzzle file</param>
+/// <param name="state">Receives the packed initial game board and its piece table</param>
+/// <param name="error">Receives what was wrong with the file on failure</param>
+/// <returns>bool: true if the file held a valid board</returns>
+bool loadBoard(const string& file, gameState& state, string& error)
+{
+    ifstream input;
+    input.open(file);
+    if (!input.is_open()) {
+        error = "cannot open " + file;
+        return false;
+    }
+    return parseBoard(input, state, error);
+}
+
+/// <summary>
+/// Builds a board state from puzzle text: one row per line, cells separated
+/// by whitespace, 'b' for a blank and '0'-'9' for pieces (0 is the king).
+/// Every piece must cover exactly one of the classic shapes and only piece 0
+/// may be the king (see parseVariantBoard), and the board must have
+/// BOARD_BLANKS blanks.
+/// </summary>
+/// <param name="input">The puzzle text</param>
+/// <param name="state">Receives the packed game board and its piece table</param>
+/// <param name="error">Receives what was wrong with the text on failure</param>
+/// <returns>bool: true if the text held a valid board</returns>
+bool parseBoard(istream& input, gameState& state, string& error)
+{
+    if (!parseVariantBoard(input, state, error))
+        return false;
+
+    // The move generator's buffers are sized for this many (see MAX_SUCCESSORS)
+    int blanks = 0;
+    for (int c = 0; c < BOARD_ROWS * BOARD_COLS; c++)
+        blanks += state.board.cellAt(c) == BLANK_CELL;
+    if (blanks != BOARD_BLANKS) {
+        error = "expected " + to_string(BOARD_BLANKS) + " blanks, found " + to_string(blanks);
+        return false;
+    }
+    return true;
+}
+
+/// <summary>
+/// Builds the piece table for a board by recording each identifier's shape
+/// and the first (top-left) cell it occupies
+/// </summary>
+/// <param name="board">The board to index</param>
+/// <returns>pieceTable: shape and anchor for every identifier on the board</returns>
+pieceTable buildPieceTable(const packedBoard& board)
+{
+    pieceTable pieces;
+    for (int i = 0; i < BOARD_ROWS; i++) {
+        for (int j = 0; j < BOARD_COLS; j++) {
+            uint8_t cell = board.cell(i, j);
+            if (cell == BLANK_CELL)
+                continue;
+
+            int id = cell & 0x0F;
+            if (pieces.anchor[id] == NO_ANCHOR) {
+                pieces.shape[id] = cell >> 4;
+                pieces.anchor[id] = uint8_t(i * BOARD_COLS + j);
+            }
+        }
+    }
+    return pieces;
+}
+
+/// <summary>
+/// Transforms a 2D board into a string
+/// </summary>
+/// <param name="board">The board to be transformed</param>
+/// <returns>string: string representation of the board</returns>
+string boardState(const packedBoard& board)
+{
+    string state = "";
+    for (int i = 0; i < BOARD_ROWS; i++) {
+        for (int j = 0; j < BOARD_COLS; j++) {
+            state.append(1, board.at(i, j));
+        }
+    }
+    return state;
+}
+
+/// <summary>
+/// Checks to see if a puzzle has successfully been completed
+/// </summary>
+/// <param name="board">The board to check the goal completion state against</param>
+/// <returns>int: 1 for success (goal completed), 0 for failure</returns>
+int checkGoal(const packedBoard& board)
+{
+    return reachedGoal(board) ? 1 : 0;
+}
+
+/// <summary>
+/// Returns the cells covered by a piece of the given shape at an anchor
+/// </summary>
+/// <param name="shape">pieceShape of the piece</param>
+/// <param name="anchor">Cell index of the top-left corner</param>
+/// <returns>uint32_t: 20-bit cell mask, or 0 if the piece would not fit on the board</returns>
+uint32_t pieceCells(int shape, int anchor)
+{
+    if (shape < 0 || shape >= classicGeometry::SHAPES || anchor < 0 || anchor >= BOARD_ROWS * BOARD_COLS)
+        return 0;
+    return classicGeometry::pieceCells(shape, anchor);
+}
+
+/// <summary>
+/// Looks up the precomputed rule for sliding a piece (see boardGeometry)
+/// </summary>
+/// <param name="shape">pieceShape of the piece</param>
+/// <param name="anchor">Cell index of the top-left corner</param>
+/// <param name="direction">moveDirection of the first step</param>
+/// <param name="secondDirection">moveDirection of the second step, or DIR_NONE</param>
+/// <returns>moveRule: required blanks, vacated cells and target anchor</returns>
+const moveRule& lookupMoveRule(int shape, int anchor, int direction, int secondDirection)
+{
+    return classicGeometry::rule(shape, anchor, direction, secondDirection);
+}
+
+/// <summary>
+/// Finds the blank cells of a board
+/// </summary>
+/// <param name="board">The board to search for blank squares</param>
+/// <returns>uint32_t: 20-bit mask of blank cells in row-major order</returns>
+uint32_t blankMask(const packedBoard& board)
+{
+    return blankCells(board);
+}
+
+/// <summary>
+/// Generates every legal successor of a state in one pass. Each piece is tried
+/// one cell in each direction against the blank-cell mask, and from every legal
+/// first step a second step is tried, so two-cell and L-shaped slides are found too.
+/// Uses no shared state, so it is safe to call from any search.
+/// </summary>
+/// <param name="state">The state to expand</param>
+/// <param name="out">Caller-provided buffer of at least MAX_SUCCESSORS entries,
+/// which holds every successor of a board with BOARD_BLANKS blanks</param>
+/// <returns>int: number of successors written to out</returns>
+int generateSuccessors(const gameState& state, successor* out)
+{
+    return generateMoves(state, out);
+}
+
+/// <summary>
+/// Moves a piece by a move rule the caller has already checked is legal
+/// </summary>
+/// <param name="state">The state to change</param>
+/// <param name="id">The piece to move</param>
+/// <param name="rule">The move, from lookupMoveRule for the piece's shape and anchor</param>
+void slidePiece(gameState& state, int id, const moveRule& rule)
+{
+    slideMove(state, id, rule);
+}
+
+/// <summary>
+/// Encodes the move between two consecutive states of a solution in one byte
+/// (see moveCode)
+/// </summary>
+/// <param name="from">The state before the move</param>
+/// <param name="to">The state after the move</param>
+/// <returns>int: the encoded move, or -1 if to is not one move from from</returns>
+int encodeMove(const gameState& from, const gameState& to)
+{
+    uint32_t blanks = blankMask(from.board);
+    for (int id = 0; id < MAX_PIECES; id++) {
+        int anchor = from.pieces.anchor[id];
+        if (anchor == to.pieces.anchor[id])
+            continue;
+
+        // Any legal path to the new anchor gives the same board
+        for (int first = 0; first < 4 && anchor != NO_ANCHOR; first++) {
+            for (int second = 0; second <= DIR_NONE; second++) {
+                const moveRule& rule = lookupMoveRule(from.pieces.shape[id], anchor, first, second);
+                if (rule.target == to.pieces.anchor[id] && (rule.need & blanks) == rule.need)
+                    return moveCode(id, first, second);
+            }
+        }
+        return -1;
+    }
+    return -1;
+}
+
+/// <summary>
+/// Applies a move from encodeMove, checking that it is legal on this state
+/// </summary>
+/// <param name="state">The state to change</param>
+/// <param name="move">The encoded move</param>
+/// <returns>bool: false, leaving state unchanged, if the move is not legal here</returns>
+bool applyMove(gameState& state, uint8_t move)
+{
+    int id = move / 20;
+    int first = move / 5 % 4;
+    int second = move % 5;
+    if (id >= MAX_PIECES || state.pieces.anchor[id] == NO_ANCHOR)
+        return false;
+
+    const moveRule& rule = lookupMoveRule(state.pieces.shape[id], state.pieces.anchor[id], first, second);
+    if (rule.target == NO_ANCHOR || (rule.need & blankMask(state.board)) != rule.need)
+        return false;
+    slidePiece(state, id, rule);
+    return true;
+}
+
+/// <summary>
+/// Turns a list of consecutive states into a solutionPath
+/// </summary>
+/// <param name="states">The states from the start to the goal, each one move from the last</param>
+solutionPath recordMoves(const vector<gameState>& states)
+{
+    solutionPath path;
+    path.start = states.front();
+    for (size_t s = 1; s < states.size(); s++)
+        path.moves.push_back(uint8_t(encodeMove(states[s - 1], states[s])));
+    return path;
+}
+
+/// <summary>
+/// Describes occupancy and probe statistics for a visited-state table
+/// </summary>
+/// <param name="close">The table to report on</param>
+string tableStats(const visitedTable& close)
+{
+    ostringstream out;
+    out << "Visited table: " << close.size() << " states in " << close.capacity() << " slots"
+        << ", load factor " << close.loadFactor()
+        << ", average probe " << close.averageProbeLength()
+        << ", longest probe " << close.maxProbeLength() << endl;
+    return out.str();
+}
+
+/// <summary>
+/// Describes how many nodes a search allocated and the memory the arena held
+/// </summary>
+/// <param name="arena">The arena to report on</param>
+string arenaStats(const nodeArena& arena)
+{
+    ostringstream out;
+    out << "Node arena: " << arena.peakSize() << " nodes of " << sizeof(node) << " bytes in "
+        << arena.chunksAllocated() << " chunks, " << arena.memoryBytes() / 1024 << " KB" << endl;
+    return out.str();
+}
+
+/// <summary>
+/// Runs a search. Running out of memory is reported as a memory limit, after
+/// the search's structures are freed, instead of ending the process.
+/// </summary>
+/// <param name="algorithm">The search to run</param>
+/// <param name="startState">The board to run it against</param>
+/// <param name="options">Threads, databases, progress counters and budgets</param>
+searchResult runSearch(const searchAlgorithm& algorithm, const gameState& startState, const searchOptions& options)
+{
+    try {
+        return algorithm.run(startState, options);
+    }
+    catch (const bad_alloc&) {
+        searchResult result;
+        result.limit = LIMIT_MEMORY;
+        return result;
+    }
+}
+
+/// <summary>
+/// Name of a budget in reports and batch records
+/// </summary>
+const char* limitName(searchLimit limit)
+{
+    switch (limit) {
+    case LIMIT_TIME:
+        return "time";
+    case LIMIT_NODES:
+        return "nodes";
+    case LIMIT_MEMORY:
+        return "memory";
+    default:
+        return "none";
+    }
+}
+
+/// <summary>
+/// Describes the type of piece given a identifier (examples: '1', '2', '3')
+/// </summary>
+/// <param name="pieces">The piece table of the board to search against</param>
+/// <param name="identifier">character that represents the piece on the 2D playing board</param>
+/// <returns>pieceShape: shape of the piece, SHAPE_BLANK for a blank, SHAPE_NONE if absent</returns>
+pieceShape checkPiece(const pieceTable& pieces, char identifier)
+{
+    if (identifier == 'b')
+        return SHAPE_BLANK;
+
+    int id = identifier - '0';
+    if (id < 0 || id >= MAX_PIECES || pieces.anchor[id] == NO_ANCHOR)
+        return SHAPE_NONE;
+
+    return pieceShape(pieces.shape[id]);
+}
+
+/// <summary>
+/// Scratch structures for a serial search: the caller's workspace, emptied,
+/// or a fresh one owned by scratch for the length of the search
+/// </summary>
+/// <param name="options">Supplies the workspace to reuse, if any</param>
+/// <param name="scratch">Receives a fresh workspace when there is none to reuse</param>
+searchWorkspace& borrowWorkspace(const searchOptions& options, unique_ptr<searchWorkspace>& scratch)
+{
+    if (!options.workspace) {
+        scratch.reset(new searchWorkspace());
+        return *scratch;
+    }
+    options.workspace->arena.reset();
+    options.workspace->visited.clear();
+    return *options.workspace;
+}
+
+/// <summary>
+/// Breadth First Search to find a solution to the game board
+/// </summary>
+/// <param name="board">The board to run BFS against</param>
+/// <param name="options">Supplies the progress counters, if any</param>
+searchResult bfs(const gameState& startState, const searchOptions& options)
+{
+    searchResult result;
+    queue<uint32_t> open;
+    unique_ptr<searchWorkspace> scratch;
+    searchWorkspace& workspace = borrowWorkspace(options, scratch);
+    nodeArena& arena = workspace.arena;
+    visitedTable& close = workspace.visited;
+    successor successors[MAX_SUCCESSORS];
+    int success = 0;
+    searchProgress* progress = SEARCH_STATS ? options.progress : NULL;
+    searchBudget budget(options);
+    long duplicates = 0;
+
+    // Nodes are expanded in allocation order, so a layer ends at the last node
+    // allocated when its first node is expanded
+    int depth = 0;
+    uint32_t layerEnd = 0;
+
+    open.push(arena.allocate(startState));
+    close.insert(canonicalKey(startState.board));
+    long gencount = 1;
+    if (progress) {
+        progress->beginPhase("search");
+        progress->layer(1);
+    }
+
+    while (!open.empty() && !success)
+    {
+        uint32_t current = open.front();
+        open.pop();
+        if (current > layerEnd) {
+            depth++;
+            layerEnd = uint32_t(arena.size() - 1);
+            if (progress)
+                progress->layer(layerEnd - current + 1);
+        }
+
+        if (checkGoal(arena[current].state.board))
+        {
+            if (progress) {
+                progress->publish(result.expanded, duplicates, open.size(), depth, arena.memoryBytes() + close.memoryBytes(), close.averageProbeLength());
+                progress->beginPhase("trace");
+            }
+            result.path = arena.trace(current);
+            success = 1;
+        }
+        else
+        {
+            result.expanded++;
+            int count = generateSuccessors(arena[current].state, successors);
+            for (int i = 0; i < count; i++) {
+                if (close.insert(canonicalKey(successors[i].state.board))) {
+                    open.push(arena.allocate(successors[i].state, current, successors[i].move()));
+                    gencount++;
+                }
+                else
+                    duplicates++;
+            }
+            if (result.expanded % PROGRESS_EVERY == 0) {
+                if (progress)
+                    progress->publish(result.expanded, duplicates, open.size(), depth, arena.memoryBytes() + close.memoryBytes(), close.averageProbeLength());
+                if (budget.spent(result.expanded, arena.memoryBytes() + close.memoryBytes()))
+                    break;
+            }
+        }
+    }
+
+    if (progress) {
+        progress->publish(result.expanded, duplicates, open.size(), depth, arena.memoryBytes() + close.memoryBytes(), close.averageProbeLength());
+        progress->finish();
+    }
+    result.solved = success;
+    if (budget.stopped())
+        recordLimit(budget, arena, 0, result);
+    result.peakBytes = arena.memoryBytes() + close.memoryBytes();
+    result.stats = "Total of " + to_string(gencount) + " nodes examined.\n" + tableStats(close) + arenaStats(arena);
+    return result;
+}
+
+/// <summary>
+/// Depth First Search to find a solution to the game board
+/// </summary>
+/// <param name="board">The board to run DFS against</param>
+/// <param name="options">Supplies the progress counters, if any</param>
+searchResult dfs(const gameState& startState, const searchOptions& options)
+{
+    searchResult result;
+    stack<uint32_t> open;
+    unique_ptr<searchWorkspace> scratch;
+    searchWorkspace& workspace = borrowWorkspace(options, scratch);
+    nodeArena& arena = workspace.arena;
+    visitedTable& close = workspace.visited;
+    successor successors[MAX_SUCCESSORS];
+    int success = 0;
+    searchProgress* progress = SEARCH_STATS ? options.progress : NULL;
+    searchBudget budget(options);
+    long duplicates = 0;
+
+    open.push(arena.allocate(startState));
+    close.insert(canonicalKey(startState.board));
+    long gencount = 1;
+    if (progress)
+        progress->beginPhase("search");
+
+    while (!open.empty() && !success)
+    {
+        uint32_t current = open.top();
+        open.pop();
+        if (checkGoal(arena[current].state.board))
+        {
+            if (progress) {
+                progress->publish(result.expanded, duplicates, open.size(), arena.depth(current), arena.memoryBytes() + close.memoryBytes(), close.averageProbeLength());
+                progress->beginPhase("trace");
+            }
+            result.path = arena.trace(current);
+            success = 1;
+        }
+        else
+        {
+            result.expanded++;
+            int count = generateSuccessors(arena[current].state, successors);
+            for (int i = 0; i < count; i++) {
+                if (close.insert(canonicalKey(successors[i].state.board))) {
+                    open.push(arena.allocate(successors[i].state, current, successors[i].move()));
+                    gencount++;
+                }
+                else
+                    duplicates++;
+            }
+            // Depth is only needed here, so it is found from the parent links
+            if (result.expanded % PROGRESS_EVERY == 0) {
+                if (progress)
+                    progress->publish(result.expanded, duplicates, open.size(), arena.depth(current), arena.memoryBytes() + close.memoryBytes(), close.averageProbeLength());
+                if (budget.spent(result.expanded, arena.memoryBytes() + close.memoryBytes()))
+                    break;
+            }
+        }
+    }
+
+    if (progress) {
+        progress->publish(result.expanded, duplicates, open.size(), 0, arena.memoryBytes() + close.memoryBytes(), close.averageProbeLength());
+        progress->finish();
+    }
+    result.solved = success;
+    if (budget.stopped())
+        recordLimit(budget, arena, 0, result);
+    result.peakBytes = arena.memoryBytes() + close.memoryBytes();
+    result.stats = "Total of " + to_string(gencount) + " nodes examined.\n" + tableStats(close) + arenaStats(arena);
+    return result;
+}
+
+/// <summary>
+/// Admissible estimate of the moves left: the king's Manhattan distance to the
+/// goal (it needs both blanks to step, so it moves one cell per move), plus one
+/// for every other piece still covering a goal cell, since each must move away
+/// before the king can land. A move changes either term by at most one, so the
+/// estimate is also consistent.
+/// </summary>
+/// <param name="state">The state to estimate</param>
+/// <returns>int: lower bound on the number of moves to reach the goal</returns>
+int heuristic(const gameState& state)
+{
+    int distance = kingDistance(state);
+    if (distance == 0)
+        return 0;
+
+    uint32_t goalCells = pieceCells(SHAPE_KING, GOAL_ANCHOR);
+    int blockers = 0;
+    for (int id = 1; id < MAX_PIECES; id++) {
+        if (state.pieces.anchor[id] != NO_ANCHOR && (pieceCells(state.pieces.shape[id], state.pieces.anchor[id]) & goalCells))
+            blockers++;
+    }
+
+    return distance + blockers;
+}
+
+/// <summary>
+/// Manhattan distance from the king to the goal anchor
+/// </summary>
+/// <returns>int: the fewest king moves left, ignoring every other piece</returns>
+int kingDistance(const gameState& state)
+{
+    int anchor = state.pieces.anchor[0];
+    return abs(anchor / BOARD_COLS - GOAL_ANCHOR / BOARD_COLS) + abs(anchor % BOARD_COLS - GOAL_ANCHOR % BOARD_COLS);
+}
+
+/// <summary>
+/// Fills in a search stopped by its budget: the limit it hit, and the deepest
+/// depth and closest king distance among the nodes it reached
+/// </summary>
+/// <param name="budget">The budget that stopped the search</param>
+/// <param name="arena">The search's nodes</param>
+/// <param name="root">The start node; nodes from other roots (goals of a backward search) are skipped</param>
+/// <param name="result">Receives the limit and the partial figures</param>
+void recordLimit(const searchBudget& budget, const nodeArena& arena, uint32_t root, searchResult& result)
+{
+    result.limit = budget.limit();
+
+    // Parents are allocated before their children, so one pass in index order finds every depth
+    vector<int> depths(arena.size(), -1);
+    for (uint32_t n = 0; n < depths.size(); n++) {
+        const node& current = arena[n];
+        if (n == root)
+            depths[n] = 0;
+        else if (current.parent != NO_NODE && depths[current.parent] >= 0)
+            depths[n] = depths[current.parent] + 1;
+        else
+            continue;
+        result.deepest = max(result.deepest, depths[n]);
+        int king = kingDistance(current.state);
+        if (result.closestKing < 0 || king < result.closestKing)
+            result.closestKing = king;
+    }
+}
+
+// A* open list entry, ordered by lowest f and then deepest g
+struct openEntry
+{
+    int f;
+    int g;
+    uint32_t n;
+
+    bool operator<(const openEntry& other) const
+    {
+        if (f != other.f)
+            return f > other.f;
+        return g < other.g;
+    }
+};
+
+/// <summary>
+/// A* Search to find an optimal solution to the game board
+/// </summary>
+/// <param name="startState">The board to run A* against</param>
+/// <param name="options">Supplies the progress counters, if any</param>
+searchResult astar(const gameState& startState, const searchOptions& options)
+{
+    searchResult result;
+    priority_queue<openEntry> open;
+    unique_ptr<searchWorkspace> scratch;
+    searchWorkspace& workspace = borrowWorkspace(options, scratch);
+    nodeArena& arena = workspace.arena;
+    visitedTable& close = workspace.visited;
+    successor successors[MAX_SUCCESSORS];
+    int success = 0;
+    long expanded = 0;
+    size_t peakOpen = 1;
+    searchProgress* progress = SEARCH_STATS ? options.progress : NULL;
+    searchBudget budget(options);
+    long duplicates = 0;
+
+    open.push({ heuristic(startState), 0, arena.allocate(startState) });
+    if (progress)
+        progress->beginPhase("search");
+
+    while (!open.empty() && !success)
+    {
+        openEntry current = open.top();
+        open.pop();
+
+        // Duplicates stay in the open list; the first copy popped has the best g
+        if (!close.insert(canonicalKey(arena[current.n].state.board))) {
+            duplicates++;
+            continue;
+        }
+        expanded++;
+
+        if (checkGoal(arena[current.n].state.board))
+        {
+            if (progress) {
+                progress->publish(expanded, duplicates, open.size(), current.g, arena.memoryBytes() + peakOpen * sizeof(openEntry) + close.memoryBytes(), close.averageProbeLength());
+                progress->beginPhase("trace");
+            }
+            result.path = arena.trace(current.n);
+            success = 1;
+        }
+        else
+        {
+            int count = generateSuccessors(arena[current.n].state, successors);
+            for (int i = 0; i < count; i++) {
+                if (close.contains(canonicalKey(successors[i].state.board))) {
+                    duplicates++;
+                    continue;
+                }
+                uint32_t succ = arena.allocate(successors[i].state, current.n, successors[i].move());
+                open.push({ current.g + 1 + heuristic(successors[i].state), current.g + 1, succ });
+            }
+            peakOpen = max(peakOpen, open.size());
+            if (expanded % PROGRESS_EVERY == 0) {
+                size_t bytes = arena.memoryBytes() + peakOpen * sizeof(openEntry) + close.memoryBytes();
+                if (progress)
+                    progress->publish(expanded, duplicates, open.size(), current.g, bytes, close.averageProbeLength());
+                if (budget.spent(expanded, bytes))
+                    break;
+            }
+        }
+    }
+
+    if (progress) {
+        progress->publish(expanded, duplicates, open.size(), 0, arena.memoryBytes() + peakOpen * sizeof(openEntry) + close.memoryBytes(), close.averageProbeLength());
+        progress->finish();
+    }
+    result.solved = success;
+    result.expanded = expanded;
+    if (budget.stopped())
+        recordLimit(budget, arena, 0, result);
+    result.peakBytes = arena.memoryBytes() + peakOpen * sizeof(openEntry) + close.memoryBytes();
+    result.stats = tableStats(close) + arenaStats(arena);
+    return result;
+}
+
+/// <summary>
+/// Iterative Deepening A* Search to find an optimal solution to the game board.
+/// Memory is the current path plus a fixed-size transposition table.
+/// </summary>
+/// <param name="startState">The board to run IDA* against</param>
+/// <param name="options">Supplies the progress counters, if any</param>
+searchResult idastar(const gameState& startState, const searchOptions& options)
+{
+    searchResult result;
+    vector<gameState> path;
+    transpositionTable seen(TRANSPOSITION_ENTRIES);
+    size_t peakDepth = 0;
+    int bound = heuristic(startState);
+    int found = 0;
+
+    searchProgress* progress = SEARCH_STATS ? options.progress : NULL;
+    searchBudget budget(options);
+    result.closestKing = kingDistance(startState);
+
+    path.push_back(startState);
+    for (int iteration = 0; !found && bound < INT_MAX; iteration++) {
+        if (progress)
+            progress->beginPhase("bound " + to_string(bound));
+        int next = idaSearch(path, 0, bound, iteration, seen, result, progress, budget);
+        peakDepth = max(peakDepth, path.capacity());
+        if (progress)
+            progress->publish(result.expanded, 0, 0, 0, peakDepth * sizeof(gameState) + seen.memoryBytes());
+        if (next == -1)
+            found = 1;
+        else if (next < 0)
+            break;
+        else
+            bound = max(next, bound + 1);
+    }
+
+    if (progress) {
+        progress->publish(result.expanded, 0, 0, 0, peakDepth * sizeof(gameState) + seen.memoryBytes());
+        progress->finish();
+    }
+    result.solved = found;
+    if (found)
+        result.path = recordMoves(path);
+    result.limit = budget.limit();
+    result.peakBytes = peakDepth * sizeof(gameState) + seen.memoryBytes();
+    return result;
+}
+
+/// <summary>
+/// One depth-first pass of IDA* below the last state on the path
+/// </summary>
+/// <param name="path">States from the start to the current state; holds the solution on success</param>
+/// <param name="g">Moves made so far</param>
+/// <param name="bound">f-cost limit for this iteration</param>
+/// <param name="iteration">Iteration number, used to age transposition entries</param>
+/// <param name="seen">Transposition table</param>
+/// <param name="result">Running count of expanded nodes, and the deepest depth and
+/// closest king distance reached, for a search stopped by its budget</param>
+/// <param name="progress">Live counters, or NULL</param>
+/// <param name="budget">Limits of the search</param>
+/// <returns>int: -1 if the goal was found, -2 if the budget ran out, otherwise a lower bound
+/// on the cost of any solution through this state (greater than bound unless the state closed a cycle)</returns>
+int idaSearch(vector<gameState>& path, int g, int bound, int iteration, transpositionTable& seen, searchResult& result, searchProgress* progress, searchBudget& budget)
+{
+    const gameState& current = path.back();
+    uint64_t key = canonicalKey(current.board);
+    const transpositionTable::entry* known = seen.find(key);
+
+    int f = g + max(heuristic(current), known ? int(known->h) : 0);
+    if (f > bound)
+        return f;
+    if (checkGoal(current.board))
+        return -1;
+
+    // Reached more cheaply before, or already searched at this depth this iteration.
+    // f is still a valid lower bound, so it is safe to back up.
+    if (known && known->iteration >= 0 && (known->g < g || (known->g == g && known->iteration == iteration)))
+        return f;
+
+    transpositionTable::entry& e = seen.claim(key);
+    e.iteration = iteration;
+    e.g = int16_t(g);
+    result.expanded++;
+    result.deepest = max(result.deepest, g);
+    result.closestKing = min(result.closestKing, kingDistance(current));
+    if (result.expanded % PROGRESS_EVERY == 0) {
+        if (progress)
+            progress->publish(result.expanded, 0, 0, g, path.capacity() * sizeof(gameState) + seen.memoryBytes());
+        if (budget.spent(result.expanded, path.capacity() * sizeof(gameState) + seen.memoryBytes()))
+            return -2;
+    }
+
+    successor successors[MAX_SUCCESSORS];
+    int estimates[MAX_SUCCESSORS];
+    int order[MAX_SUCCESSORS];
+    int count = generateSuccessors(current, successors);
+
+    // Try the most promising successors first
+    for (int i = 0; i < count; i++) {
+        estimates[i] = heuristic(successors[i].state);
+        int j = i;
+        while (j > 0 && estimates[order[j - 1]] > estimates[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    int minimum = INT_MAX;
+    for (int i = 0; i < count; i++) {
+        path.push_back(successors[order[i]].state);
+        int t = idaSearch(path, g + 1, bound, iteration, seen, result, progress, budget);
+        if (t < 0)
+            return t;
+        path.pop_back();
+        minimum = min(minimum, t);
+    }
+
+    // Keep the backed-up bound for later iterations; the slot may have been
+    // taken over by another state during the recursion
+    if (minimum != INT_MAX) {
+        transpositionTable::entry& after = seen.claim(key);
+        after.h = int16_t(max(int(after.h), minimum - g));
+    }
+    return minimum;
+}
+
+/// <summary>
+/// Enumerates every goal board with the same piece inventory as a state: the
+/// king on the goal anchor and all other pieces and blanks placed every legal
+/// way. Boards that are mirror images or relabelings of each other are kept once.
+/// </summary>
+/// <param name="state">Any state of the puzzle; only its piece inventory is used</param>
+/// <returns>vector<gameState>: one board per distinct goal position</returns>
+vector<gameState> enumerateGoals(const gameState& state)
+{
+    int counts[4] = { 0, 0, 0, 0 };
+    vector<char> ids[4];
+    int covered = 0;
+    for (int id = 0; id < MAX_PIECES; id++) {
+        if (state.pieces.anchor[id] == NO_ANCHOR)
+            continue;
+        int shape = state.pieces.shape[id];
+        counts[shape]++;
+        ids[shape].push_back(char('0' + id));
+        covered += (shape == SHAPE_KING) ? 4 : (shape == SHAPE_SQUARE ? 1 : 2);
+    }
+
+    vector<gameState> goals;
+    if (counts[SHAPE_KING] != 1)
+        return goals;
+
+    gameState goal;
+    uint32_t filled = pieceCells(SHAPE_KING, GOAL_ANCHOR);
+    for (int c = 0; c < BOARD_ROWS * BOARD_COLS; c++) {
+        if (filled & (uint32_t(1) << c))
+            goal.board.setCell(c / BOARD_COLS, c % BOARD_COLS, uint8_t(SHAPE_KING << 4));
+    }
+    goal.pieces.shape[0] = SHAPE_KING;
+    goal.pieces.anchor[0] = GOAL_ANCHOR;
+    counts[SHAPE_KING] = 0;
+
+    placeGoalPieces(goal, filled, counts, ids, BOARD_ROWS * BOARD_COLS - covered, goals);
+
+    // Keep one board per canonical key
+    visitedTable seen(goals.size() + 1);
+    vector<gameState> distinct;
+    for (size_t i = 0; i < goals.size(); i++) {
+        if (seen.insert(canonicalKey(goals[i].board)))
+            distinct.push_back(goals[i]);
+    }
+    return distinct;
+}
+
+/// <summary>
+/// Recursive helper for enumerateGoals: fills the first empty cell with a blank
+/// or with the top-left corner of each remaining piece that fits there
+/// </summary>
+/// <param name="state">Partially filled board</param>
+/// <param name="filled">Mask of cells already filled</param>
+/// <param name="counts">Pieces of each shape still to place</param>
+/// <param name="ids">Identifiers of each shape, used in order</param>
+/// <param name="blanks">Blank cells still to place</param>
+/// <param name="goals">Receives every completed board</param>
+void placeGoalPieces(gameState& state, uint32_t filled, int counts[4], vector<char> ids[4], int blanks, vector<gameState>& goals)
+{
+    const uint32_t full = (uint32_t(1) << (BOARD_ROWS * BOARD_COLS)) - 1;
+    if (filled == full) {
+        goals.push_back(state);
+        return;
+    }
+
+    int cell = lowestCell(~filled & full);
+    if (blanks > 0) {
+        state.board.setCell(cell / BOARD_COLS, cell % BOARD_COLS, BLANK_CELL);
+        placeGoalPieces(state, filled | (uint32_t(1) << cell), counts, ids, blanks - 1, goals);
+    }
+
+    for (int shape = SHAPE_VERTICAL; shape <= SHAPE_SQUARE; shape++) {
+        uint32_t cells = pieceCells(shape, cell);
+        if (counts[shape] == 0 || !cells || (cells & filled))
+            continue;
+
+        char identifier = ids[shape][ids[shape].size() - counts[shape]];
+        int id = identifier - '0';
+        for (uint32_t c = cells; c; c &= c - 1) {
+            int index = lowestCell(c);
+            state.board.setCell(index / BOARD_COLS, index % BOARD_COLS, uint8_t((shape << 4) | id));
+        }
+        state.pieces.shape[id] = uint8_t(shape);
+        state.pieces.anchor[id] = uint8_t(cell);
+
+        counts[shape]--;
+        placeGoalPieces(state, filled | cells, counts, ids, blanks, goals);
+        counts[shape]++;
+        state.pieces.anchor[id] = NO_ANCHOR;
+    }
+}
+
+/// <summary>
+/// Appends the moves that follow a node's chain of parents in a backward search
+/// up to the goal board at its root. The boards in the arena match the real ones
+/// only up to relabeling and mirroring, so each step is replayed from the real
+/// board by matching canonical keys.
+/// </summary>
+/// <param name="arena">Arena of a backward search, rooted at goal boards</param>
+/// <param name="from">The node to start from</param>
+/// <param name="current">The real board at that node</param>
+/// <param name="path">Receives the moves</param>
+void replayToRoot(const nodeArena& arena, uint32_t from, gameState current, solutionPath& path)
+{
+    successor successors[MAX_SUCCESSORS];
+    for (uint32_t n = arena[from].parent; n != NO_NODE; n = arena[n].parent) {
+        uint64_t want = canonicalKey(arena[n].state.board);
+        int count = generateSuccessors(current, successors);
+        for (int i = 0; i < count; i++) {
+            if (canonicalKey(successors[i].state.board) == want) {
+                path.moves.push_back(successors[i].move());
+                current = successors[i].state;
+                break;
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Bidirectional Breadth First Search: a forward search from the start and a
+/// backward search seeded with every goal board, each advanced a full layer at a
+/// time on whichever frontier is smaller, until the two meet. Moves are
+/// reversible, so the backward search uses the same move generator.
+/// On the bundled puzzles it saves little over bfs: the goal boards for a piece
+/// inventory number in the thousands (4125 for HR138) while the forward frontier
+/// never passes a few hundred, so the backward side is rarely expanded and the
+/// search ends one forward layer before bfs would.
+/// </summary>
+/// <param name="startState">The board to run the search against</param>
+/// <param name="options">Supplies the progress counters, if any</param>
+searchResult bidirectional(const gameState& startState, const searchOptions& options)
+{
+    searchResult result;
+    searchProgress* progress = SEARCH_STATS ? options.progress : NULL;
+    searchBudget budget(options);
+    long duplicates = 0;
+    vector<gameState> goals = enumerateGoals(startState);
+    if (goals.empty())
+        return result;
+
+    unique_ptr<searchWorkspace> scratch;
+    nodeArena& arena = borrowWorkspace(options, scratch).arena;
+    unordered_map<uint64_t, uint32_t> seen[2];
+    vector<uint32_t> frontier[2];
+    successor successors[MAX_SUCCESSORS];
+    seen[0].reserve(EXPECTED_STATES);
+    seen[1].reserve(EXPECTED_STATES);
+    auto mapBytes = [&]() {
+        size_t bytes = 0;
+        for (int side = 0; side < 2; side++)
+            bytes += seen[side].size() * (sizeof(pair<const uint64_t, uint32_t>) + sizeof(void*)) + seen[side].bucket_count() * sizeof(void*);
+        return bytes;
+    };
+
+    uint32_t start = arena.allocate(startState);
+    seen[0][canonicalKey(startState.board)] = start;
+    frontier[0].push_back(start);
+    for (size_t i = 0; i < goals.size(); i++) {
+        uint32_t goal = arena.allocate(goals[i]);
+        seen[1][canonicalKey(goals[i].board)] = goal;
+        frontier[1].push_back(goal);
+    }
+
+    // Best meeting found so far: a forward node and the backward node it links to
+    uint32_t meetForward = NO_NODE;
+    uint32_t meetBackward = NO_NODE;
+    int depth[2] = { 0, 0 };
+    int bestLength = INT_MAX;
+
+    if (seen[1].count(canonicalKey(startState.board))) {
+        meetForward = start;
+        meetBackward = seen[1][canonicalKey(startState.board)];
+        bestLength = 0;
+    }
+
+    if (progress)
+        progress->beginPhase("search");
+    while (bestLength == INT_MAX && !frontier[0].empty() && !frontier[1].empty() && !budget.stopped()) {
+        int side = frontier[0].size() <= frontier[1].size() ? 0 : 1;
+        int other = 1 - side;
+        vector<uint32_t> next;
+
+        for (size_t f = 0; f < frontier[side].size(); f++) {
+            uint32_t current = frontier[side][f];
+            result.expanded++;
+            if (result.expanded % PROGRESS_EVERY == 0) {
+                if (progress)
+                    progress->publish(result.expanded, duplicates, frontier[0].size() + frontier[1].size() - f + next.size(),
+                        depth[0] + depth[1], arena.memoryBytes());
+                // A partial layer may have missed a shorter meeting, so it is dropped
+                if (budget.spent(result.expanded, arena.memoryBytes() + mapBytes())) {
+                    meetForward = NO_NODE;
+                    break;
+                }
+            }
+            int count = generateSuccessors(arena[current].state, successors);
+            for (int i = 0; i < count; i++) {
+                uint64_t key = canonicalKey(successors[i].state.board);
+                if (seen[side].count(key)) {
+                    duplicates++;
+                    continue;
+                }
+
+                uint32_t succ = arena.allocate(successors[i].state, current, successors[i].move());
+                seen[side][key] = succ;
+                next.push_back(succ);
+
+                auto match = seen[other].find(key);
+                if (match != seen[other].end()) {
+                    // Every node on the other side is at most depth[other] deep, so
+                    // finishing this layer and keeping the shortest link is optimal
+                    int length = depth[side] + 1 + depth[other];
+                    if (length < bestLength) {
+                        bestLength = length;
+                        meetForward = side == 0 ? succ : match->second;
+                        meetBackward = side == 0 ? match->second : succ;
+                    }
+                }
+            }
+        }
+
+        frontier[side].swap(next);
+        depth[side]++;
+    }
+
+    if (progress)
+        progress->beginPhase("trace");
+    if (meetForward != NO_NODE) {
+        // Forward half: the moves from the start to the meeting state
+        solutionPath path = arena.trace(meetForward);
+
+        // Backward half: from the real meeting board to a goal
+        replayToRoot(arena, meetBackward, arena[meetForward].state, path);
+
+        result.solved = true;
+        result.path = path;
+    }
+
+    if (budget.stopped())
+        recordLimit(budget, arena, start, result);
+    result.peakBytes = arena.memoryBytes() + mapBytes();
+    if (progress) {
+        progress->publish(result.expanded, duplicates, frontier[0].size() + frontier[1].size(), depth[0] + depth[1], result.peakBytes);
+        progress->finish();
+    }
+    result.stats = "Total of: " + to_string(seen[0].size()) + " forward and " + to_string(seen[1].size())
+        + " backward states from " + to_string(goals.size()) + " goal boards.\n" + arenaStats(arena);
+    return result;
+}
+
+/// <summary>
+/// Multi-source search: solves many boards with one breadth-first search
+/// backwards from every goal board, instead of a search per board. A board is
+/// labeled in the layer that first reaches it, which is its distance to the
+/// nearest goal, so each board still gets a shortest solution. Boards are
+/// grouped by piece inventory, one search per group, and each search stops once
+/// every board of its group is labeled or its state space is exhausted.
+/// </summary>
+/// <param name="starts">The boards to solve</param>
+/// <param name="options">Supplies the progress counters, the budget for each group's search and the workspace</param>
+/// <returns>vector<searchResult>: one per board, in order. Expanded states, memory
+/// and stats are those of the whole search for the board's group.</returns>
+vector<searchResult> multiSourceSearch(const vector<gameState>& starts, const searchOptions& options)
+{
+    vector<searchResult> results(starts.size());
+    vector<bool> grouped(starts.size(), false);
+    searchProgress* progress = SEARCH_STATS ? options.progress : NULL;
+    long expanded = 0;
+
+    if (progress)
+        progress->beginPhase("search");
+    for (size_t first = 0; first < starts.size(); first++) {
+        if (grouped[first])
+            continue;
+        uint8_t inventory[4];
+        pieceInventory(starts[first].pieces, inventory);
+        vector<size_t> group;
+        for (size_t s = first; s < starts.size(); s++) {
+            uint8_t other[4];
+            pieceInventory(starts[s].pieces, other);
+            if (!grouped[s] && memcmp(inventory, other, sizeof(other)) == 0) {
+                grouped[s] = true;
+                group.push_back(s);
+            }
+        }
+        try {
+            multiSourceGroup(starts, group, options, expanded, results);
+        }
+        catch (const bad_alloc&) {
+            // As in runSearch: out of memory ends the group's search as a memory limit
+            for (size_t g = 0; g < group.size(); g++) {
+                results[group[g]] = searchResult();
+                results[group[g]].limit = LIMIT_MEMORY;
+            }
+        }
+    }
+    if (progress)
+        progress->finish();
+    return results;
+}
+
+/// <summary>
+/// One backward search of multiSourceSearch, for boards sharing a piece inventory
+/// </summary>
+/// <param name="starts">All the boards</param>
+/// <param name="group">Indexes of the boards in this group</param>
+/// <param name="options">Supplies the progress counters, the budget and the workspace</param>
+/// <param name="expanded">States expanded by earlier groups, for the progress counters; this search's are added</param>
+/// <param name="results">Receives the result of each board in the group</param>
+void multiSourceGroup(const vector<gameState>& starts, const vector<size_t>& group, const searchOptions& options, long& expanded, vector<searchResult>& results)
+{
+    vector<gameState> goals = enumerateGoals(starts[group[0]]);
+    if (goals.empty())
+        return;
+
+    searchProgress* progress = SEARCH_STATS ? options.progress : NULL;
+    searchBudget budget(options);
+    unique_ptr<searchWorkspace> scratch;
+    searchWorkspace& workspace = borrowWorkspace(options, scratch);
+    nodeArena& arena = workspace.arena;
+    visitedTable& close = workspace.visited;
+    successor successors[MAX_SUCCESSORS];
+    long groupExpanded = 0;
+    long duplicates = 0;
+
+    // Boards still waiting for a label, by canonical key
+    unordered_map<uint64_t, vector<size_t>> waiting;
+    for (size_t g = 0; g < group.size(); g++)
+        waiting[canonicalKey(starts[group[g]].board)].push_back(group[g]);
+
+    auto label = [&](uint32_t n, uint64_t key) {
+        auto match = waiting.find(key);
+        if (match == waiting.end())
+            return;
+        for (size_t w = 0; w < match->second.size(); w++) {
+            searchResult& result = results[match->second[w]];
+            result.solved = true;
+            result.path.start = starts[match->second[w]];
+            replayToRoot(arena, n, starts[match->second[w]], result.path);
+        }
+        waiting.erase(match);
+    };
+
+    for (size_t i = 0; i < goals.size(); i++) {
+        uint64_t key = canonicalKey(goals[i].board);
+        close.insert(key);
+        label(arena.allocate(goals[i]), key);
+    }
+
+    // Nodes are expanded in allocation order, as in bfs
+    int depth = 0;
+    uint32_t layerEnd = uint32_t(arena.size() - 1);
+    if (progress)
+        progress->layer(arena.size());
+    for (uint32_t current = 0; current < arena.size() && !waiting.empty(); current++) {
+        if (current > layerEnd) {
+            depth++;
+            layerEnd = uint32_t(arena.size() - 1);
+            if (progress)
+                progress->layer(layerEnd - current + 1);
+        }
+
+        groupExpanded++;
+        int count = generateSuccessors(arena[current].state, successors);
+        for (int i = 0; i < count; i++) {
+            uint64_t key = canonicalKey(successors[i].state.board);
+            if (close.insert(key))
+                label(arena.allocate(successors[i].state, current, successors[i].move()), key);
+            else
+                duplicates++;
+        }
+        if (groupExpanded % PROGRESS_EVERY == 0) {
+            if (progress)
+                progress->publish(expanded + groupExpanded, duplicates, arena.size() - current - 1, depth, arena.memoryBytes() + close.memoryBytes(), close.averageProbeLength());
+            if (budget.spent(groupExpanded, arena.memoryBytes() + close.memoryBytes()))
+                break;
+        }
+    }
+
+    expanded += groupExpanded;
+    if (progress)
+        progress->publish(expanded, duplicates, 0, depth, arena.memoryBytes() + close.memoryBytes(), close.averageProbeLength());
+
+    // Boards never reached are unsolvable, or beyond the depth the budget allowed
+    for (auto w = waiting.begin(); w != waiting.end(); ++w) {
+        for (size_t s = 0; s < w->second.size(); s++) {
+            searchResult& result = results[w->second[s]];
+            result.limit = budget.limit();
+            if (budget.stopped())
+                result.deepest = depth;
+        }
+    }
+
+    string stats = "Total of " + to_string(arena.size()) + " states from " + to_string(goals.size()) + " goal boards, "
+        + to_string(depth) + " layers, shared by " + to_string(group.size()) + " boards.\n" + tableStats(close) + arenaStats(arena);
+    for (size_t g = 0; g < group.size(); g++) {
+        searchResult& result = results[group[g]];
+        result.expanded = groupExpanded;
+        result.peakBytes = arena.memoryBytes() + close.memoryBytes();
+        result.stats = stats;
+    }
+}
+
+/// <summary>
+/// Resolves a requested thread count, where anything below 1 means one per core
+/// </summary>
+int threadCount(int requested)
+{
+    if (requested > 0)
+        return requested;
+    int cores = int(thread::hardware_concurrency());
+    return cores > 0 ? cores : 1;
+}
+
+/// <summary>
+/// Level-synchronous parallel Breadth First Search. Each layer is split into
+/// contiguous slices, one per worker; workers expand their slice into private
+/// buffers while claiming keys in a shared concurrentTable, then each keeps the
+/// successors whose ordinal won. Ordinals follow the serial scan order, so the
+/// next layer, and therefore the solution, is exactly the one bfs() produces.
+/// </summary>
+/// <param name="startState">The board to run the search against</param>
+/// <param name="pool">Workers that expand each layer</param>
+/// <param name="arena">Holds every node of the search</param>
+/// <param name="expanded">Receives the number of states expanded; the goal layer is not expanded, so this can be a little under bfs()</param>
+/// <param name="explored">Receives the number of distinct states reached</param>
+/// <param name="tableBytes">Receives the size of the shared visited table</param>
+/// <param name="progress">Live counters, or NULL</param>
+/// <param name="budget">Limits of the search, checked after each layer</param>
+/// <returns>uint32_t: the goal node, or NO_NODE if the puzzle has no solution or the budget ran out</returns>
+uint32_t parallelBfsSearch(const gameState& startState, workerPool& pool, nodeArena& arena, long& expanded, size_t& explored, size_t& tableBytes, searchProgress* progress, searchBudget& budget)
+{
+    struct candidate
+    {
+        gameState state;
+        uint32_t parent;
+        uint8_t move;
+        uint64_t ordinal;
+        size_t slot;
+    };
+
+    int workers = pool.size();
+    concurrentTable close(EXPECTED_STATES);
+    vector<vector<candidate>> buffers(workers);
+    vector<vector<uint32_t>> kept(workers);
+
+    uint32_t start = arena.allocate(startState);
+    close.settle(close.claim(canonicalKey(startState.board), 0));
+    vector<uint32_t> layer(1, start);
+    uint32_t goal = checkGoal(startState.board) ? start : NO_NODE;
+    int depth = 0;
+    expanded = 0;
+    long duplicates = 0;
+    if (progress) {
+        progress->beginPhase("search");
+        progress->layer(1);
+    }
+
+    while (goal == NO_NODE && !layer.empty() && !budget.spent(expanded, arena.memoryBytes() + close.memoryBytes())) {
+        close.reserve(close.size() + layer.size() * MAX_SUCCESSORS);
+
+        pool.run([&](int worker) {
+            size_t begin = layer.size() * worker / workers;
+            size_t end = layer.size() * (worker + 1) / workers;
+            successor successors[MAX_SUCCESSORS];
+            vector<candidate>& buffer = buffers[worker];
+            buffer.clear();
+
+            for (size_t p = begin; p < end; p++) {
+                int count = generateSuccessors(arena[layer[p]].state, successors);
+                for (int i = 0; i < count; i++) {
+                    // Ordinal 0 is reserved for settled keys
+                    uint64_t ordinal = uint64_t(p) * MAX_SUCCESSORS + i + 1;
+                    candidate c;
+                    c.state = successors[i].state;
+                    c.parent = uint32_t(p);
+                    c.move = successors[i].move();
+                    c.ordinal = ordinal;
+                    c.slot = close.claim(canonicalKey(c.state.board), ordinal);
+                    buffer.push_back(c);
+                }
+            }
+        });
+
+        pool.run([&](int worker) {
+            kept[worker].clear();
+            const vector<candidate>& buffer = buffers[worker];
+            for (size_t i = 0; i < buffer.size(); i++) {
+                if (close.owner(buffer[i].slot) == buffer[i].ordinal)
+                    kept[worker].push_back(arena.allocate(buffer[i].state, layer[buffer[i].parent], buffer[i].move));
+            }
+        });
+
+        // Merge in worker order, which is the serial order, and close the layer
+        vector<uint32_t> next;
+        for (int w = 0; w < workers; w++) {
+            for (size_t i = 0; i < kept[w].size(); i++) {
+                uint32_t n = kept[w][i];
+                next.push_back(n);
+                if (goal == NO_NODE && checkGoal(arena[n].state.board))
+                    goal = n;
+            }
+            for (size_t i = 0; i < buffers[w].size(); i++) {
+                if (close.owner(buffers[w][i].slot) == buffers[w][i].ordinal)
+                    close.settle(buffers[w][i].slot);
+            }
+            duplicates += long(buffers[w].size() - kept[w].size());
+        }
+        expanded += long(layer.size());
+        depth++;
+        if (progress) {
+            progress->layer(next.size());
+            progress->publish(expanded, duplicates, next.size(), depth, arena.memoryBytes() + close.memoryBytes());
+        }
+        layer.swap(next);
+    }
+    if (progress)
+        progress->finish();
+
+    explored = close.size();
+    tableBytes = close.memoryBytes();
+    return goal;
+}
+
+/// <summary>
+/// Parallel BFS search mode: solves one puzzle on its own worker pool
+/// </summary>
+/// <param name="startState">The board to run the search against</param>
+/// <param name="options">Worker threads, 0 for one per core</param>
+searchResult parallelBfs(const gameState& startState, const searchOptions& options)
+{
+    int threads = threadCount(options.threads);
+
+    searchResult result;
+    workerPool pool(threads);
+    nodeArena arena;
+    long expanded = 0;
+    size_t explored = 0;
+    size_t tableBytes = 0;
+    searchBudget budget(options);
+    uint32_t goal = parallelBfsSearch(startState, pool, arena, expanded, explored, tableBytes, SEARCH_STATS ? options.progress : NULL, budget);
+
+    if (goal != NO_NODE) {
+        result.solved = true;
+        result.path = arena.trace(goal);
+    }
+    else if (budget.stopped())
+        recordLimit(budget, arena, 0, result);
+    result.expanded = expanded;
+    result.peakBytes = arena.memoryBytes() + tableBytes;
+    result.stats = to_string(threads) + " threads, " + to_string(explored) + " states explored.\n" + arenaStats(arena);
+    return result;
+}
+
+/// <summary>
+/// Work-stealing parallel depth-first driver. Each worker runs a depth-first
+/// search from its own deque and, when that runs dry, steals from the front of
+/// another worker's deque. Duplicates are pruned across threads through a shared
+/// concurrentTable. The first worker to reach the goal publishes it and every
+/// other worker stops at its next pop.
+/// With a negative bound this is a plain DFS: a state is expanded only by the
+/// first thread to reach it. Otherwise it runs one IDA* iteration: successors
+/// with g + h over the bound are cut, a state is expanded again only when
+/// reached at a smaller depth than before, and every finished subtree backs up
+/// its lower bound into bounds so later iterations start from a better h.
+/// </summary>
+/// <param name="startState">The board to run the search against</param>
+/// <param name="pool">Workers that run the search</param>
+/// <param name="bound">f bound for an IDA* iteration, or -1 for a plain DFS</param>
+/// <param name="bounds">Backed-up heuristic values kept across iterations, NULL for a plain DFS</param>
+/// <param name="nextBound">Receives the smallest f that was cut, INT_MAX if none</param>
+/// <param name="arena">Holds every node of the search, shared by all workers</param>
+/// <param name="expanded">Receives the number of states expanded</param>
+/// <param name="tableBytes">Receives the size of the shared visited table</param>
+/// <param name="progress">Live counters, or NULL</param>
+/// <param name="budget">Limits of the search; running out of memory in a worker also stops it</param>
+/// <returns>uint32_t: the goal node, or NO_NODE if none was reached</returns>
+uint32_t parallelDepthFirst(const gameState& startState, workerPool& pool, int bound, concurrentTable* bounds, int& nextBound, nodeArena& arena, long& expanded, size_t& tableBytes, searchProgress* progress, searchBudget& budget)
+{
+    int workers = pool.size();
+    concurrentTable seen(EXPECTED_STATES);
+    unique_ptr<stealingDeque[]> deques(new stealingDeque[workers]);
+    vector<long> counts(workers, 0);
+    atomic<uint32_t> solution(NO_NODE);
+    atomic<long> pending(1);    // states pushed and not yet fully expanded
+    atomic<int> cut(INT_MAX);
+    vector<vector<searchFrame*>> frames(workers);
+
+    uint32_t start = arena.allocate(startState);
+    uint64_t startKey = canonicalKey(startState.board);
+    seen.offer(startKey, 0);
+    searchFrame* root = NULL;
+    if (bound >= 0) {
+        root = new searchFrame(NULL, startKey, 0);
+        frames[0].push_back(root);
+    }
+    deques[0].items.push_back({ start, 0, root });
+
+    pool.run([&](int worker) {
+        // A worker that cannot allocate stops them all; its siblings would
+        // otherwise wait forever for the states it held
+        try {
+            stealingDeque& own = deques[worker];
+            successor successors[MAX_SUCCESSORS];
+
+            while (solution.load(memory_order_acquire) == NO_NODE && !budget.stopped()) {
+                stealingDeque::item item;
+                bool have = false;
+                {
+                    lock_guard<mutex> hold(own.lock);
+                    if (!own.items.empty()) {
+                        item = own.items.back();
+                        own.items.pop_back();
+                        have = true;
+                    }
+                }
+                for (int k = 1; !have && k < workers; k++) {
+                    stealingDeque& victim = deques[(worker + k) % workers];
+                    lock_guard<mutex> hold(victim.lock);
+                    if (!victim.items.empty()) {
+                        item = victim.items.front();
+                        victim.items.pop_front();
+                        have = true;
+                    }
+                }
+                if (!have) {
+                    if (pending.load(memory_order_acquire) == 0)
+                        return;
+                    this_thread::yield();
+                    continue;
+                }
+
+                if (checkGoal(arena[item.n].state.board)) {
+                    uint32_t none = NO_NODE;
+                    solution.compare_exchange_strong(none, item.n, memory_order_acq_rel);
+                    pending.fetch_sub(1, memory_order_acq_rel);
+                    return;
+                }
+
+                // Workers add their expansions in batches, so the shared counters
+                // are touched once per PROGRESS_EVERY states
+                counts[worker]++;
+                if (counts[worker] % PROGRESS_EVERY == 0) {
+                    if (progress) {
+                        progress->expanded.fetch_add(PROGRESS_EVERY, memory_order_relaxed);
+                        progress->depth.store(item.g, memory_order_relaxed);
+                        progress->frontier.store(uint64_t(pending.load(memory_order_relaxed)), memory_order_relaxed);
+                    }
+                    if (budget.charge(PROGRESS_EVERY, arena.memoryBytes() + seen.memoryBytes()))
+                        return;
+                }
+                int count = generateSuccessors(arena[item.n].state, successors);
+                for (int i = 0; i < count; i++) {
+                    int g = item.g + 1;
+                    uint64_t key = canonicalKey(successors[i].state.board);
+                    searchFrame* frame = NULL;
+                    if (bound >= 0) {
+                        int f = g + max(heuristic(successors[i].state), knownBound(*bounds, key));
+                        if (f > bound) {
+                            lowerAtomic(cut, f);
+                            lowerAtomic(item.frame->best, f);
+                            continue;
+                        }
+                        // Already reached at this depth or less: f still bounds this path
+                        if (seen.offer(key, uint64_t(g)) <= uint64_t(g)) {
+                            lowerAtomic(item.frame->best, f);
+                            continue;
+                        }
+                        frame = new searchFrame(item.frame, key, g);
+                        frames[worker].push_back(frame);
+                        item.frame->outstanding.fetch_add(1, memory_order_acq_rel);
+                    }
+                    else if (seen.offer(key, 0) != UINT64_MAX)
+                        continue;
+
+                    uint32_t succ = arena.allocate(successors[i].state, item.n, successors[i].move());
+                    pending.fetch_add(1, memory_order_acq_rel);
+                    lock_guard<mutex> hold(own.lock);
+                    own.items.push_back({ succ, g, frame });
+                }
+                if (item.frame)
+                    finishFrame(item.frame, *bounds);
+                pending.fetch_sub(1, memory_order_acq_rel);
+            }
+        }
+        catch (const bad_alloc&) {
+            budget.stop(LIMIT_MEMORY);
+        }
+    });
+
+    expanded = 0;
+    for (int w = 0; w < workers; w++) {
+        expanded += counts[w];
+        for (size_t j = 0; j < frames[w].size(); j++)
+            delete frames[w][j];
+    }
+    nextBound = cut.load();
+    tableBytes = seen.memoryBytes();
+    return solution.load();
+}
+
+/// <summary>
+/// Atomic fetch-min on an int
+/// </summary>
+void lowerAtomic(atomic<int>& value, int candidate)
+{
+    int current = value.load(memory_order_relaxed);
+    while (candidate < current && !value.compare_exchange_weak(current, candidate, memory_order_acq_rel))
+        ;
+}
+
+/// <summary>
+/// Backed-up heuristic value for a state. concurrentTable values only decrease,
+/// so bounds are stored as UINT64_MAX - h and a raise becomes a fetch-min.
+/// </summary>
+/// <returns>int: the best proven lower bound on moves to the goal, 0 if none</returns>
+int knownBound(concurrentTable& bounds, uint64_t key)
+{
+    return int(UINT64_MAX - bounds.offer(key, UINT64_MAX));
+}
+
+/// <summary>
+/// Releases one outstanding count on a frame. Each frame that finishes stores
+/// its backed-up bound and passes it to its parent, which may finish in turn.
+/// </summary>
+/// <param name="frame">The frame whose state or child just finished</param>
+/// <param name="bounds">Backed-up heuristic values kept across iterations</param>
+void finishFrame(searchFrame* frame, concurrentTable& bounds)
+{
+    while (frame && frame->outstanding.fetch_sub(1, memory_order_acq_rel) == 1) {
+        int best = frame->best.load(memory_order_acquire);
+        if (best != INT_MAX) {
+            bounds.offer(frame->key, UINT64_MAX - uint64_t(best - frame->g));
+            if (frame->parent)
+                lowerAtomic(frame->parent->best, best);
+        }
+        frame = frame->parent;
+    }
+}
+
+/// <summary>
+/// Parallel DFS search mode: returns the first solution any worker finds
+/// </summary>
+/// <param name="startState">The board to run the search against</param>
+/// <param name="options">Worker threads, 0 for one per core</param>
+searchResult parallelDfs(const gameState& startState, const searchOptions& options)
+{
+    int threads = threadCount(options.threads);
+
+    searchResult result;
+    workerPool pool(threads);
+    nodeArena arena;
+    int nextBound = 0;
+    size_t tableBytes = 0;
+    searchProgress* progress = SEARCH_STATS ? options.progress : NULL;
+    searchBudget budget(options);
+    if (progress)
+        progress->beginPhase("search");
+    uint32_t goal = parallelDepthFirst(startState, pool, -1, NULL, nextBound, arena, result.expanded, tableBytes, progress, budget);
+    if (progress) {
+        progress->publish(result.expanded, 0, 0, 0, arena.memoryBytes() + tableBytes);
+        progress->finish();
+    }
+
+    if (goal != NO_NODE) {
+        result.solved = true;
+        result.path = arena.trace(goal);
+    }
+    else if (budget.stopped())
+        recordLimit(budget, arena, 0, result);
+    result.peakBytes = arena.memoryBytes() + tableBytes;
+    result.stats = to_string(threads) + " threads.\n" + arenaStats(arena);
+    return result;
+}
+
+/// <summary>
+/// Parallel IDA* menu mode: runs each iteration through the work-stealing driver.
+/// Every state within a bound is searched before the bound grows, so the first
+/// solution found is optimal.
+/// </summary>
+/// <param name="startState">The board to run the search against</param>
+/// <param name="options">Worker threads, 0 for one per core</param>
+searchResult parallelIdastar(const gameState& startState, const searchOptions& options)
+{
+    int threads = threadCount(options.threads);
+
+    searchResult result;
+    workerPool pool(threads);
+    concurrentTable bounds(EXPECTED_STATES);
+    nodeArena arena;
+    long total = 0;
+    size_t tableBytes = 0;
+    uint32_t goal = NO_NODE;
+
+    searchProgress* progress = SEARCH_STATS ? options.progress : NULL;
+    searchBudget budget(options);
+
+    for (int bound = heuristic(startState); goal == NO_NODE && bound != INT_MAX;) {
+        int nextBound = INT_MAX;
+        long expanded = 0;
+        if (progress)
+            progress->beginPhase("bound " + to_string(bound));
+        goal = parallelDepthFirst(startState, pool, bound, &bounds, nextBound, arena, expanded, tableBytes, progress, budget);
+        total += expanded;
+        if (progress)
+            progress->publish(total, 0, 0, 0, arena.memoryBytes() + bounds.memoryBytes() + tableBytes);
+
+        // Workers only check the budget every PROGRESS_EVERY states each, so
+        // short iterations are checked here. The last iteration's nodes are
+        // kept for the partial figures.
+        if (goal == NO_NODE && budget.spent(total, arena.memoryBytes() + bounds.memoryBytes() + tableBytes)) {
+            recordLimit(budget, arena, 0, result);
+            break;
+        }
+        if (goal == NO_NODE) {
+            arena.release();
+            bound = max(nextBound, bound + 1);
+        }
+    }
+
+    if (goal != NO_NODE) {
+        result.solved = true;
+        result.path = arena.trace(goal);
+    }
+    if (progress)
+        progress->finish();
+    result.expanded = total;
+    result.peakBytes = arena.memoryBytes() + bounds.memoryBytes() + tableBytes;
+    result.stats = to_string(threads) + " threads.\n" + arenaStats(arena);
+    return result;
+}
+
+/// <summary>
+/// Counts the pieces of each shape on a board
+/// </summary>
+/// <param name="pieces">The piece table of the board</param>
+/// <param name="inventory">Receives the count for each pieceShape below SHAPE_BLANK</param>
+void pieceInventory(const pieceTable& pieces, uint8_t inventory[4])
+{
+    for (int shape = 0; shape < 4; shape++)
+        inventory[shape] = 0;
+    for (int id = 0; id < MAX_PIECES; id++) {
+        if (pieces.anchor[id] != NO_ANCHOR)
+            inventory[pieces.shape[id]]++;
+    }
+}
+
+/// <summary>
+/// Enumerates every solvable state with a state's piece inventory by a
+/// breadth-first search backwards from all goal boards. Moves are reversible, so
+/// the forward move generator walks the retrograde graph too, and the layer a
+/// state is first reached in is its distance to the nearest goal.
+/// </summary>
+/// <param name="state">Any board of the layout class</param>
+/// <param name="database">Receives the table</param>
+/// <param name="error">Receives the reason on failure</param>
+/// <returns>bool: true if the table was built</returns>
+bool buildDistanceDatabase(const gameState& state, distanceDatabase& database, string& error)
+{
+    vector<gameState> layer = enumerateGoals(state);
+    if (layer.empty()) {
+        error = "the board needs exactly one king";
+        return false;
+    }
+
+    vector<pair<uint64_t, uint8_t>> found;
+    visitedTable close(EXPECTED_STATES);
+    successor successors[MAX_SUCCESSORS];
+    for (size_t i = 0; i < layer.size(); i++) {
+        close.insert(canonicalKey(layer[i].board));
+        found.push_back(make_pair(canonicalKey(layer[i].board), uint8_t(0)));
+    }
+
+    int depth = 0;
+    while (!layer.empty()) {
+        if (depth + 1 > UINT8_MAX) {
+            error = "distances exceed the one-byte table format";
+            return false;
+        }
+
+        vector<gameState> next;
+        for (size_t s = 0; s < layer.size(); s++) {
+            int count = generateSuccessors(layer[s], successors);
+            for (int i = 0; i < count; i++) {
+                uint64_t key = canonicalKey(successors[i].state.board);
+                if (close.insert(key)) {
+                    next.push_back(successors[i].state);
+                    found.push_back(make_pair(key, uint8_t(depth + 1)));
+                }
+            }
+        }
+        if (!next.empty())
+            depth++;
+        layer.swap(next);
+    }
+
+    uint8_t inventory[4];
+    pieceInventory(state.pieces, inventory);
+    database.assign(found, inventory, uint32_t(depth));
+    return true;
+}
+
+/// <summary>
+/// Solves a puzzle from a distance database: from each state, step to any
+/// successor one move closer to the goal. No search, so the cost is the
+/// solution length times the branching factor, plus one lookup per successor.
+/// </summary>
+/// <param name="startState">The board to solve</param>
+/// <param name="options">Supplies the databases, one of which must cover the board's piece inventory</param>
+searchResult databaseWalk(const gameState& startState, const searchOptions& options)
+{
+    searchResult result;
+    const distanceDatabase* database = NULL;
+    uint8_t inventory[4];
+    pieceInventory(startState.pieces, inventory);
+    for (size_t d = 0; d < options.databases.size() && !database; d++) {
+        if (options.databases[d]->covers(inventory))
+            database = options.databases[d];
+    }
+    if (!database) {
+        result.error = "no distance database for this piece inventory";
+        return result;
+    }
+
+    searchProgress* progress = SEARCH_STATS ? options.progress : NULL;
+    if (progress)
+        progress->beginPhase("walk");
+
+    int distance = database->distance(canonicalKey(startState.board));
+    successor successors[MAX_SUCCESSORS];
+    gameState current = startState;
+    result.path.start = startState;
+
+    while (distance > 0) {
+        int count = generateSuccessors(current, successors);
+        int i = 0;
+        while (i < count && database->distance(canonicalKey(successors[i].state.board)) != distance - 1)
+            i++;
+        if (i == count)
+            break;      // only a damaged table can get here
+
+        result.path.moves.push_back(successors[i].move());
+        current = successors[i].state;
+        result.expanded++;
+        distance--;
+    }
+
+    if (progress) {
+        progress->publish(result.expanded, 0, 0, int(result.path.steps()), database->memoryBytes());
+        progress->finish();
+    }
+    result.solved = distance == 0 && checkGoal(current.board);
+    if (!result.solved)
+        result.path.moves.clear();
+    result.peakBytes = database->memoryBytes();
+    result.stats = "Distance database: " + to_string(database->size()) + " states, farthest "
+        + to_string(database->info().maxDistance) + " moves from a goal, " + to_string(database->fileBytes() / 1024) + " KB mapped.\n";
+    return result;
+}
+
+/// <summary>
+/// Rebuilds a board from its canonical key. The key holds shapes only, so the
+/// pieces are numbered in reading order, the king 0 and the rest from 1; the
+/// board is a relabeling (or mirror image) of every board with that key.
+/// </summary>
+/// <param name="key">A key from canonicalKey</param>
+/// <param name="state">Receives the board and its piece table</param>
+/// <returns>bool: false if the key does not describe a board</returns>
+bool decodeCanonicalKey(uint64_t key, gameState& state)
+{
+    packedBoard board;
+    uint32_t filled = 0;
+    int nextId = 1;
+    for (int c = 0; c < BOARD_ROWS * BOARD_COLS; c++) {
+        if (filled & (uint32_t(1) << c))
+            continue;
+
+        int shape;
+        switch (int(key >> (c * 3)) & 7) {
+        case CANON_BLANK:
+            board.setCell(c / BOARD_COLS, c % BOARD_COLS, BLANK_CELL);
+            filled |= uint32_t(1) << c;
+            continue;
+        case CANON_KING:
+            shape = SHAPE_KING;
+            break;
+        case CANON_VERTICAL_TOP:
+            shape = SHAPE_VERTICAL;
+            break;
+        case CANON_HORIZONTAL_LEFT:
+            shape = SHAPE_HORIZONTAL;
+            break;
+        case CANON_SQUARE:
+            shape = SHAPE_SQUARE;
+            break;
+        default:
+            return false;
+        }
+
+        uint32_t cells = pieceCells(shape, c);
+        int id = shape == SHAPE_KING ? 0 : nextId++;
+        if (!cells || (cells & filled) || id >= MAX_PIECES)
+            return false;
+        for (uint32_t rest = cells; rest; rest &= rest - 1) {
+            int index = lowestCell(rest);
+            board.setCell(index / BOARD_COLS, index % BOARD_COLS, uint8_t((shape << 4) | id));
+        }
+        filled |= cells;
+    }
+
+    state.board = board;
+    state.pieces = buildPieceTable(board);
+    return true;
+}
+
+/// <summary>
+/// Sorts a buffer of keys, drops repeats and writes it out as a run. The
+/// buffer is left empty with its capacity kept.
+/// </summary>
+/// <returns>bool: false with error set if the file cannot be written</returns>
+bool writeKeyRun(vector<uint64_t>& keys, const string& file, string& error)
+{
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    keyRunWriter out(file);
+    for (size_t k = 0; k < keys.size(); k++)
+        out.add(keys[k]);
+    keys.clear();
+    if (!out.close()) {
+        error = "failed writing " + file;
+        return false;
+    }
+    return true;
+}
+
+/// <summary>
+/// Merges sorted runs into one run without repeats, leaving out every key that
+/// is in one of the exclude runs. All the runs are read once, in step.
+/// </summary>
+/// <param name="runs">The runs to merge</param>
+/// <param name="exclude">Runs whose keys are left out of the output</param>
+/// <param name="output">The merged run</param>
+/// <param name="written">Receives the number of keys in the output</param>
+/// <returns>bool: false with error set if the output cannot be written</returns>
+bool mergeKeyRuns(const vector<string>& runs, const vector<string>& exclude, const string& output, size_t& written, string& error)
+{
+    vector<unique_ptr<keyRunReader>> inputs;
+    vector<unique_ptr<keyRunReader>> excluded;
+    typedef pair<uint64_t, size_t> head;
+    priority_queue<head, vector<head>, greater<head>> heads;
+    for (size_t r = 0; r < runs.size(); r++) {
+        inputs.push_back(unique_ptr<keyRunReader>(new keyRunReader(runs[r])));
+        if (inputs.back()->valid())
+            heads.push(head(inputs.back()->key(), r));
+    }
+    for (size_t e = 0; e < exclude.size(); e++)
+        excluded.push_back(unique_ptr<keyRunReader>(new keyRunReader(exclude[e])));
+
+    keyRunWriter out(output);
+    bool any = false;
+    uint64_t last = 0;
+    while (!heads.empty()) {
+        head top = heads.top();
+        heads.pop();
+        keyRunReader& input = *inputs[top.second];
+        input.next();
+        if (input.valid())
+            heads.push(head(input.key(), top.second));
+
+        if (any && top.first == last)
+            continue;
+        any = true;
+        last = top.first;
+
+        bool seen = false;
+        for (size_t e = 0; e < excluded.size() && !seen; e++) {
+            while (excluded[e]->valid() && excluded[e]->key() < top.first)
+                excluded[e]->next();
+            seen = excluded[e]->valid() && excluded[e]->key() == top.first;
+        }
+        if (!seen)
+            out.add(top.first);
+    }
+
+    written = out.size();
+    if (!out.close()) {
+        error = "failed writing " + output;
+        return false;
+    }
+    return true;
+}
+
+/// <summary>
+/// External-memory Breadth First Search, for state spaces too large for the
+/// visited table. Each layer is a sorted run of canonical keys on disk. The
+/// successors of a layer collect in a buffer, sorted into a run file whenever
+/// it fills; at the end of the layer the runs are merged into the next layer,
+/// dropping keys already in the current or previous layer (moves are reversible,
+/// so no other layer can hold a successor: delayed duplicate detection). States
+/// are rebuilt from their keys to be expanded. Memory stays within maxBytes
+/// (EXTERNAL_MEMORY if there is none; at least a few blocks of KEY_BLOCK keys):
+/// half for the buffer, half for the blocks of the runs being merged, merging in
+/// several passes when there are more runs than that allows. Every layer stays on disk until the search ends,
+/// so the solution is traced back through them, one lookup per step.
+/// </summary>
+/// <param name="startState">The board to run the search against</param>
+/// <param name="options">Supplies the progress counters, the budget and the spill directory</param>
+searchResult externalBfs(const gameState& startState, const searchOptions& options)
+{
+    searchResult result;
+    searchProgress* progress = SEARCH_STATS ? options.progress : NULL;
+    searchBudget budget(options);
+    spillDirectory spill;
+    if (!spill.create(options.spillDirectory, result.error))
+        return result;
+
+    const size_t blockBytes = KEY_BLOCK * sizeof(uint64_t);
+    size_t memory = options.maxBytes ? options.maxBytes : EXTERNAL_MEMORY;
+    size_t bufferKeys = max(memory / 2 / sizeof(uint64_t), KEY_BLOCK);
+    // The final merge also reads the two layers it excludes and writes the next
+    size_t fanIn = max(memory > bufferKeys * sizeof(uint64_t) ? (memory - bufferKeys * sizeof(uint64_t)) / blockBytes : 0, size_t(5)) - 3;
+
+    vector<uint64_t> buffer;
+    buffer.reserve(bufferKeys);
+    successor successors[MAX_SUCCESSORS];
+    size_t peakBytes = buffer.capacity() * sizeof(uint64_t) + 2 * blockBytes;
+    size_t states = 1;
+    size_t runFiles = 0;
+    uint64_t bytesWritten = sizeof(uint64_t);
+    long generated = 0;
+    long duplicates = 0;
+    int closest = INT_MAX;
+    error_code code;
+    auto layerFile = [&](int depth) { return spill.file("layer" + to_string(depth)); };
+
+    {
+        keyRunWriter first(layerFile(0));
+        first.add(canonicalKey(startState.board));
+        if (!first.close()) {
+            result.error = "failed writing " + layerFile(0);
+            return result;
+        }
+    }
+
+    int depth = 0;
+    size_t layerSize = 1;
+    bool found = false;
+    uint64_t goalKey = 0;
+    if (progress) {
+        progress->beginPhase("search");
+        progress->layer(1);
+    }
+
+    while (layerSize > 0 && !found && !budget.stopped()) {
+        vector<string> runs;
+        size_t position = 0;
+        for (keyRunReader layer(layerFile(depth)); layer.valid() && result.error.empty(); layer.next(), position++) {
+            gameState state;
+            decodeCanonicalKey(layer.key(), state);
+            if (checkGoal(state.board)) {
+                found = true;
+                goalKey = layer.key();
+                break;
+            }
+
+            result.expanded++;
+            closest = min(closest, kingDistance(state));
+            int count = generateSuccessors(state, successors);
+            generated += count;
+            for (int i = 0; i < count; i++) {
+                buffer.push_back(canonicalKey(successors[i].state.board));
+                if (buffer.size() == bufferKeys) {
+                    runs.push_back(spill.file("run" + to_string(runFiles++)));
+                    bytesWritten += bufferKeys * sizeof(uint64_t);
+                    if (!writeKeyRun(buffer, runs.back(), result.error))
+                        break;
+                }
+            }
+
+            if (result.expanded % PROGRESS_EVERY == 0) {
+                size_t held = buffer.capacity() * sizeof(uint64_t) + 2 * blockBytes;
+                peakBytes = max(peakBytes, held);
+                if (progress)
+                    progress->publish(result.expanded, duplicates, layerSize - position - 1, depth, held);
+                if (budget.spent(result.expanded, held))
+                    break;
+            }
+        }
+        if (found || budget.stopped() || !result.error.empty())
+            break;
+
+        if (!buffer.empty()) {
+            runs.push_back(spill.file("run" + to_string(runFiles++)));
+            bytesWritten += buffer.size() * sizeof(uint64_t);
+            if (!writeKeyRun(buffer, runs.back(), result.error))
+                break;
+        }
+
+        // Too many runs to read in step: merge them a group at a time first
+        while (runs.size() > fanIn && result.error.empty()) {
+            vector<string> group(runs.begin(), runs.begin() + fanIn);
+            runs.erase(runs.begin(), runs.begin() + fanIn);
+            runs.push_back(spill.file("run" + to_string(runFiles++)));
+            size_t merged = 0;
+            if (mergeKeyRuns(group, vector<string>(), runs.back(), merged, result.error))
+                bytesWritten += merged * sizeof(uint64_t);
+            for (size_t g = 0; g < group.size(); g++)
+                filesystem::remove(group[g], code);
+        }
+        if (!result.error.empty())
+            break;
+
+        vector<string> exclude(1, layerFile(depth));
+        if (depth > 0)
+            exclude.push_back(layerFile(depth - 1));
+        peakBytes = max(peakBytes, buffer.capacity() * sizeof(uint64_t) + (runs.size() + exclude.size() + 1) * blockBytes);
+        if (!mergeKeyRuns(runs, exclude, layerFile(depth + 1), layerSize, result.error))
+            break;
+        for (size_t r = 0; r < runs.size(); r++)
+            filesystem::remove(runs[r], code);
+
+        bytesWritten += layerSize * sizeof(uint64_t);
+        duplicates = generated - long(states + layerSize - 1);
+        states += layerSize;
+        depth++;
+        if (progress)
+            progress->layer(layerSize);
+    }
+
+    if (progress) {
+        progress->publish(result.expanded, duplicates, 0, depth, peakBytes);
+        progress->beginPhase("trace");
+    }
+    if (found) {
+        // Back from the goal, any key of the layer above that is a neighbour
+        // lies on a shortest path; then replay that chain from the real start
+        vector<uint64_t> chain(depth + 1);
+        chain[depth] = goalKey;
+        for (int d = depth; d > 0; d--) {
+            gameState state;
+            decodeCanonicalKey(chain[d], state);
+            int count = generateSuccessors(state, successors);
+            for (int i = 0; i < count; i++) {
+                uint64_t key = canonicalKey(successors[i].state.board);
+                if (keyRunReader::contains(layerFile(d - 1), key)) {
+                    chain[d - 1] = key;
+                    break;
+                }
+            }
+        }
+
+        gameState current = startState;
+        result.path.start = startState;
+        for (int d = 1; d <= depth; d++) {
+            int count = generateSuccessors(current, successors);
+            for (int i = 0; i < count; i++) {
+                if (canonicalKey(successors[i].state.board) == chain[d]) {
+                    result.path.moves.push_back(successors[i].move());
+                    current = successors[i].state;
+                    break;
+                }
+            }
+        }
+        result.solved = checkGoal(current.board) != 0;
+        if (!result.solved)
+            result.error = "could not trace the solution through the layer files";
+    }
+
+    if (budget.stopped()) {
+        result.limit = budget.limit();
+        result.deepest = depth;
+        result.closestKing = closest == INT_MAX ? -1 : closest;
+    }
+    result.peakBytes = peakBytes;
+    if (progress)
+        progress->finish();
+    result.stats = "Total of " + to_string(states) + " states in " + to_string(depth + 1) + " layers, "
+        + to_string(runFiles) + " run files, " + to_string(bytesWritten / 1024) + " KB written.\n";
+    return result;
+}
+
+// Board variants
+
+/// <summary>
+/// Builds a state of any geometry from puzzle text in the parseBoard format.
+/// Each piece's shape is the one whose footprint matches the cells it covers,
+/// so every identifier must cover a shape of the geometry's set.
+/// </summary>
+/// <param name="input">The puzzle text</param>
+/// <param name="state">Receives the packed game board and its piece table</param>
+/// <param name="error">Receives what was wrong with the text on failure</param>
+/// <returns>bool: true if the text held a valid board</returns>
+template <class Geometry>
+bool parseVariantBoard(istream& input, basicState<Geometry>& state, string& error)
+{
+    const int ROWS = Geometry::ROWS;
+    const int COLS = Geometry::COLS;
+    vector<vector<char>> vect;
+
+    string line;
+    while (getline(input, line)) {
+        istringstream iss(line);
+        vector<char> row;
+        char elem;
+        while (iss >> elem)
+            row.push_back(elem);
+
+        if (row.empty())
+            continue;
+        if (row.size() != size_t(COLS)) {
+            error = "row " + to_string(vect.size() + 1) + " does not have " + to_string(COLS) + " cells";
+            return false;
+        }
+        for (int i = 0; i < COLS; i++) {
+            if (row[i] != 'b' && (row[i] < '0' || row[i] > '9')) {
+                error = string("unexpected cell '") + row[i] + "'";
+                return false;
+            }
+        }
+
+        vect.push_back(row);
+    }
+
+    if (vect.size() != size_t(ROWS)) {
+        error = "expected " + to_string(ROWS) + " rows, found " + to_string(vect.size());
+        return false;
+    }
+
+    // The top-left corner of each piece's bounding box is its anchor
+    int top[MAX_PIECES], left[MAX_PIECES];
+    fill(top, top + MAX_PIECES, ROWS);
+    fill(left, left + MAX_PIECES, COLS);
+    for (int i = 0; i < ROWS; i++) {
+        for (int j = 0; j < COLS; j++) {
+            if (vect[i][j] == 'b')
+                continue;
+            int id = vect[i][j] - '0';
+            top[id] = min(top[id], i);
+            left[id] = min(left[id], j);
+        }
+    }
+
+    uint16_t footprint[MAX_PIECES] = {};
+    for (int i = 0; i < ROWS; i++) {
+        for (int j = 0; j < COLS; j++) {
+            if (vect[i][j] == 'b')
+                continue;
+            int id = vect[i][j] - '0';
+            if (i - top[id] > 2 || j - left[id] > 2) {
+                error = string("piece ") + vect[i][j] + " does not fit in a 3x3 box";
+                return false;
+            }
+            footprint[id] |= uint16_t(1 << ((i - top[id]) * 3 + (j - left[id])));
+        }
+    }
+
+    state = basicState<Geometry>();
+    for (int id = 0; id < MAX_PIECES; id++) {
+        if (!footprint[id])
+            continue;
+        int shape = 0;
+        while (shape < Geometry::SHAPES && Geometry::shapes::FOOTPRINT[shape] != footprint[id])
+            shape++;
+        if (shape == Geometry::SHAPES) {
+            error = "piece " + to_string(id) + " does not match any piece shape";
+            return false;
+        }
+        if ((id == 0) != (shape == SHAPE_KING)) {
+            error = id == 0 ? "piece 0 must be the 2x2 king" : "piece " + to_string(id) + " is 2x2, but only piece 0 may be the king";
+            return false;
+        }
+        state.pieces.shape[id] = uint8_t(shape);
+        state.pieces.anchor[id] = uint8_t(top[id] * COLS + left[id]);
+    }
+    if (state.pieces.anchor[0] == NO_ANCHOR) {
+        error = "the board has no king (piece 0)";
+        return false;
+    }
+
+    for (int i = 0; i < ROWS; i++) {
+        for (int j = 0; j < COLS; j++) {
+            int id = vect[i][j] - '0';
+            state.board.setCell(i, j, vect[i][j] == 'b' ? BLANK_CELL : uint8_t((state.pieces.shape[id] << 4) | id));
+        }
+    }
+    return true;
+}
+
+// Key of a variant board for variantBfs: 7 bits a cell, 0 for a blank and
+// otherwise 1 + shape * 9 + the cell's bit in the shape's footprint. Pieces of
+// one shape are interchangeable, so boards that differ only in which of them is
+// where share a key, and the footprint bit keeps touching pieces apart.
+template <class Geometry>
+struct variantKey
+{
+    public:
+        static const int WORDS = (Geometry::CELLS * 7 + 63) / 64;
+
+        uint64_t word[WORDS] = {};
+
+        explicit variantKey(const basicState<Geometry>& state)
+        {
+            for (int id = 0; id < MAX_PIECES; id++) {
+                int anchor = state.pieces.anchor[id];
+                if (anchor == NO_ANCHOR)
+                    continue;
+                int shape = state.pieces.shape[id];
+                for (typename Geometry::cellMask cells = Geometry::pieceCells(shape, anchor); cells; cells &= cells - 1) {
+                    int c = lowestCell(cells);
+                    int bit = (c / Geometry::COLS - anchor / Geometry::COLS) * 3 + (c % Geometry::COLS - anchor % Geometry::COLS);
+                    uint64_t code = uint64_t(1 + shape * 9 + bit);
+                    word[c * 7 / 64] |= code << (c * 7 % 64);
+                    if (c * 7 % 64 > 57)
+                        word[c * 7 / 64 + 1] |= code >> (64 - c * 7 % 64);
+                }
+            }
+        }
+
+        bool operator==(const variantKey& other) const
+        {
+            return equal(word, word + WORDS, other.word);
+        }
+
+        struct hasher
+        {
+            size_t operator()(const variantKey& key) const
+            {
+                uint64_t h = 0;
+                for (int w = 0; w < WORDS; w++)
+                    h = hashKey(h ^ key.word[w]);
+                return size_t(h);
+            }
+        };
+};
+
+/// <summary>
+/// Breadth-first search on a board of any geometry. Like bfs it stops at the
+/// first goal it expands, so the solution is a shortest one, and it honours
+/// the budget in options; it has no mirror folding, arena or progress.
+/// </summary>
+/// <param name="startState">The board to solve</param>
+/// <param name="options">Budget for the search</param>
+/// <returns>variantResult: the moves when solved, and the search statistics</returns>
+template <class Geometry>
+variantResult variantBfs(const basicState<Geometry>& startState, const searchOptions& options)
+{
+    typedef variantKey<Geometry> key;
+    variantResult result;
+    searchBudget budget(options);
+    basicSuccessor<Geometry> successors[MAX_ANY_SUCCESSORS];
+
+    vector<basicState<Geometry>> states(1, startState);
+    vector<uint32_t> parents(1, NO_NODE);
+    vector<uint8_t> moves(1, NO_MOVE);
+    unordered_set<key, typename key::hasher> seen;
+    seen.insert(key(startState));
+
+    auto heldBytes = [&] {
+        return states.capacity() * (sizeof(basicState<Geometry>) + sizeof(uint32_t) + sizeof(uint8_t))
+            + seen.size() * (sizeof(key) + 2 * sizeof(void*)) + seen.bucket_count() * sizeof(void*);
+    };
+
+    int depth = 0;
+    size_t layerEnd = 0;
+    uint32_t goal = NO_NODE;
+    try {
+        for (size_t current = 0; current < states.size(); current++) {
+            if (current > layerEnd) {
+                depth++;
+                layerEnd = states.size() - 1;
+            }
+            if (reachedGoal(states[current].board)) {
+                goal = uint32_t(current);
+                break;
+            }
+
+            result.expanded++;
+            int count = generateMoves(states[current], successors);
+            for (int i = 0; i < count; i++) {
+                if (seen.insert(key(successors[i].state)).second) {
+                    states.push_back(successors[i].state);
+                    parents.push_back(uint32_t(current));
+                    moves.push_back(successors[i].move());
+                }
+            }
+            if (result.expanded % PROGRESS_EVERY == 0) {
+                result.peakBytes = max(result.peakBytes, heldBytes());
+                if (budget.spent(result.expanded, heldBytes()))
+                    break;
+            }
+        }
+    }
+    catch (const bad_alloc&) {
+        budget.stop(LIMIT_MEMORY);
+    }
+    result.peakBytes = max(result.peakBytes, heldBytes());
+
+    if (goal != NO_NODE) {
+        result.solved = true;
+        for (uint32_t n = goal; parents[n] != NO_NODE; n = parents[n])
+            result.moves.push_back(moves[n]);
+        reverse(result.moves.begin(), result.moves.end());
+    }
+    else if (budget.stopped()) {
+        result.limit = budget.limit();
+        result.deepest = depth;
+    }
+    return result;
+}
+
+/// <summary>
+/// Reads a board of one geometry and solves it with variantBfs (the solve
+/// entry of each BOARD_VARIANTS row)
+/// </summary>
+/// <param name="input">The puzzle text</param>
+/// <param name="options">Budget for the search</param>
+/// <returns>variantResult: with error set if the text is not a board of the geometry</returns>
+template <class Geometry>
+variantResult solveVariant(istream& input, const searchOptions& options)
+{
+    basicState<Geometry> start;
+    variantResult result;
+    if (!parseVariantBoard(input, start, result.error))
+        return result;
+    return variantBfs(start, options);
+}
+
+/// <summary>
+/// Writes a move as text: the piece, then the direction of each step, so "7U"
+/// is one cell up and "4RD" right then down
+/// </summary>
+/// <param name="move">The move, as moveCode encodes it</param>
+/// <returns>string: the move's text</returns>
+string moveText(uint8_t move)
+{
+    static const char DIRECTIONS[] = { 'U', 'D', 'L', 'R' };
+    string text(1, char('0' + move / 20));
+    text += DIRECTIONS[move / 5 % 4];
+    if (move % 5 != DIR_NONE)
+        text += DIRECTIONS[move % 5];
+    return text;
+}
+
+// Library API (see Huarong.h)
+
+namespace huarong
+{
+    struct solver::state
+    {
+        vector<unique_ptr<distanceDatabase>> databases;
+    };
+
+    solver::solver() : loaded(new state()) {}
+
+    solver::~solver() {}
+
+    bool solver::loadDatabase(const string& file, string& error)
+    {
+        unique_ptr<distanceDatabase> database(new distanceDatabase());
+        if (!database->load(file, error))
+            return false;
+        loaded->databases.push_back(move(database));
+        return true;
+    }
+
+    vector<string> solver::algorithms()
+    {
+        vector<string> names;
+        for (int a = 0; a < ALGORITHM_COUNT; a++)
+            names.push_back(SEARCH_ALGORITHMS[a].name);
+        return names;
+    }
+
+    struct workspace::state
+    {
+        searchWorkspace work;
+        size_t keepBytes;
+    };
+
+    workspace::workspace(size_t keepBytes) : held(new state())
+    {
+        held->keepBytes = keepBytes;
+    }
+
+    workspace::~workspace() {}
+
+    solveResult solver::solve(const solveRequest& request) const
+    {
+        return run(request, NULL);
+    }
+
+    solveResult solver::solve(const solveRequest& request, workspace& scratch) const
+    {
+        return run(request, &scratch);
+    }
+
+    solveResult solver::run(const solveRequest& request, workspace* scratch) const
+    {
+        static const char DIRECTIONS[] = { 'U', 'D', 'L', 'R', 0 };
+        solveResult result;
+
+        const searchAlgorithm* algorithm = NULL;
+        for (int a = 0; a < ALGORITHM_COUNT && !algorithm; a++) {
+            if (request.algorithm == SEARCH_ALGORITHMS[a].name)
+                algorithm = &SEARCH_ALGORITHMS[a];
+        }
+        if (!algorithm) {
+            result.status = "error";
+            result.error = "unknown algorithm " + request.algorithm;
+            return result;
+        }
+
+        gameState board;
+        istringstream text(request.board);
+        if (!parseBoard(text, board, result.error)) {
+            result.status = "error";
+            return result;
+        }
+
+        searchOptions options;
+        options.threads = request.threads;
+        options.maxSeconds = request.maxSeconds;
+        options.maxExpanded = request.maxExpanded;
+        options.maxBytes = request.maxBytes;
+        for (size_t d = 0; d < loaded->databases.size(); d++)
+            options.databases.push_back(loaded->databases[d].get());
+        if (scratch)
+            options.workspace = &scratch->held->work;
+
+        auto start = chrono::steady_clock::now();
+        searchResult found = runSearch(*algorithm, board, options);
+        result.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+        // A workspace grown past its limit by a large search is given back
+        if (scratch) {
+            searchWorkspace& work = scratch->held->work;
+            if (work.arena.heldBytes() + work.visited.memoryBytes() > scratch->held->keepBytes) {
+                work.arena.release();
+                work.visited = visitedTable(EXPECTED_STATES);
+            }
+        }
+        result.expanded = found.expanded;
+        result.peakBytes = found.peakBytes;
+
+        if (!found.error.empty()) {
+            result.status = "error";
+            result.error = found.error;
+        }
+        else if (found.solved) {
+            result.status = "solved";
+            for (size_t m = 0; m < found.path.moves.size(); m++) {
+                // Decodes moveCode: (id * 4 + direction) * 5 + second direction
+                int code = found.path.moves[m];
+                result.moves.push_back({ char('0' + code / 20), DIRECTIONS[code / 5 % 4], DIRECTIONS[code % 5] });
+            }
+        }
+        else if (found.limit != LIMIT_NONE) {
+            result.status = "limit";
+            result.limit = limitName(found.limit);
+            result.deepest = found.deepest;
+            result.kingDistance = found.closestKing;
+        }
+        else
+            result.status = "unsolved";
+        return result;
+    }
+}
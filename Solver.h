@@ -0,0 +1,1984 @@
+// Solver.h
+// Internal declarations shared by the solver library (Solver.cpp) and the
+// Huarong CLI: the board representation, the search structures and the
+// searches themselves. Code embedding the solver includes Huarong.h instead.
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <fstream>
+#include <stack>
+#include <queue>
+#include <cstdlib>
+#include <climits>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <new>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <filesystem>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Board geometry
+// The board's dimensions and piece shapes are compile-time parameters of a
+// boardGeometry, which builds the move tables and goal cells for them. The
+// searches all run on classicGeometry, the 5x4 board with the four classic
+// shapes; other geometries are solved by variantBfs.
+
+// Index of the lowest set bit of a non-zero cell mask
+inline int lowestCell(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return int(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+inline int lowestCell(uint64_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return int(index);
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+// Piece shapes stored in the high bits of each packed cell. These are the
+// classic shapes; a shape set may add more after SHAPE_SQUARE, but shape 0 is
+// always the 2x2 king.
+enum pieceShape : uint8_t
+{
+    SHAPE_KING = 0,
+    SHAPE_VERTICAL = 1,
+    SHAPE_HORIZONTAL = 2,
+    SHAPE_SQUARE = 3,
+    SHAPE_BLANK = 4,    // only returned by checkPiece, never stored in a cell
+    SHAPE_NONE = 5      // identifier not on the board
+};
+
+// A blank cell has identifier nibble 0xF and no shape
+const uint8_t BLANK_CELL = 0x0F;
+const uint8_t NO_ANCHOR = 0xFF;
+
+// Directions a piece can slide
+enum moveDirection : uint8_t
+{
+    DIR_UP = 0,
+    DIR_DOWN = 1,
+    DIR_LEFT = 2,
+    DIR_RIGHT = 3,
+    DIR_NONE = 4
+};
+
+// Shape Set Structs
+// The pieces a geometry knows, by shape index. Each footprint is a 3x3 box of
+// cells (bit row * 3 + col) whose top-left corner is the piece's anchor, even
+// where the piece does not cover that corner.
+struct classicShapes
+{
+    static constexpr int COUNT = 4;
+    static constexpr uint16_t FOOTPRINT[COUNT] = { 0x1B, 0x09, 0x03, 0x01 };   // king, vertical, horizontal, square
+};
+
+// The classic shapes plus the four L-shaped pieces of three cells, each a 2x2
+// box missing its bottom-right, bottom-left, top-right or top-left corner
+struct extendedShapes
+{
+    static constexpr int COUNT = 8;
+    static constexpr uint16_t FOOTPRINT[COUNT] = { 0x1B, 0x09, 0x03, 0x01, 0x0B, 0x13, 0x19, 0x1A };
+};
+
+// Move Rule Struct
+// One precomputed entry per (shape, anchor, first step, second step). A move
+// slides one piece one cell, or two cells along a straight or L-shaped path, and
+// counts as a single step. Cell sets are masks in row-major order; a move is
+// legal when every cell in need is blank.
+template <class Mask>
+struct basicMoveRule
+{
+    public:
+        Mask need = 0;      // cells the piece passes over or lands on, must all be blank
+        Mask cover = 0;     // cells the piece newly covers once the move is done
+        Mask vacate = 0;    // cells the piece leaves
+        uint8_t target = NO_ANCHOR;  // anchor after the move, NO_ANCHOR if off the board
+};
+
+// Board Geometry Struct
+// A board of Rows x Cols cells and a shape set, with the cells each shape
+// covers at each anchor and the rule for every slide of every shape from every
+// anchor worked out at compile time. Masks take 32 bits when the board fits.
+// Cells pack a 4-bit identifier under the shape index: 6 bits a cell for up to
+// four shapes, 7 bits for more.
+template <int Rows, int Cols, class Shapes>
+struct boardGeometry
+{
+    static_assert(Rows >= 2 && Cols >= 2 && Rows * Cols <= 64, "a board has 4 to 64 cells");
+    static_assert(Shapes::COUNT <= 8, "a shape set has at most 8 shapes");
+
+    typedef Shapes shapes;
+    typedef typename conditional<Rows * Cols <= 32, uint32_t, uint64_t>::type cellMask;
+    typedef basicMoveRule<cellMask> moveRule;
+
+    static constexpr int ROWS = Rows;
+    static constexpr int COLS = Cols;
+    static constexpr int CELLS = Rows * Cols;
+    static constexpr int SHAPES = Shapes::COUNT;
+    static constexpr int CELL_BITS = SHAPES <= 4 ? 6 : 7;
+    static constexpr uint8_t CELL_MASK = uint8_t((1 << CELL_BITS) - 1);
+    static constexpr int CELLS_PER_WORD = 64 / CELL_BITS;
+    static constexpr int WORDS = (CELLS + CELLS_PER_WORD - 1) / CELLS_PER_WORD;
+    // The king's anchor when it reaches the exit: the bottom two rows, centred
+    // (left of centre on an odd width)
+    static constexpr int GOAL_ANCHOR = (Rows - 2) * Cols + (Cols - 2) / 2;
+
+    // Cells a shape covers from an anchor, 0 if it does not fit
+    static constexpr cellMask pieceCells(int shape, int anchor) { return TABLES.cells[shape][anchor]; }
+
+    static constexpr const moveRule& rule(int shape, int anchor, int direction, int secondDirection)
+    {
+        return TABLES.rules[shape][anchor][direction][secondDirection];
+    }
+
+    private:
+        struct tables
+        {
+            cellMask cells[SHAPES][CELLS] = {};
+            moveRule rules[SHAPES][CELLS][4][5] = {};
+        };
+
+        static constexpr cellMask footprint(int shape, int row, int col)
+        {
+            if (row < 0 || col < 0 || row >= Rows || col >= Cols)
+                return 0;
+            cellMask cells = 0;
+            for (int bit = 0; bit < 9; bit++) {
+                if (!((Shapes::FOOTPRINT[shape] >> bit) & 1))
+                    continue;
+                int r = row + bit / 3;
+                int c = col + bit % 3;
+                if (r >= Rows || c >= Cols)
+                    return 0;
+                cells |= cellMask(1) << (r * Cols + c);
+            }
+            return cells;
+        }
+
+        static constexpr tables build()
+        {
+            const int rowStep[4] = { -1, 1, 0, 0 };
+            const int colStep[4] = { 0, 0, -1, 1 };
+            tables t;
+            for (int shape = 0; shape < SHAPES; shape++) {
+                for (int anchor = 0; anchor < CELLS; anchor++) {
+                    // Set outright: GCC drops the member default in a constant-evaluated array
+                    for (int first = 0; first < 4; first++) {
+                        for (int second = 0; second <= DIR_NONE; second++)
+                            t.rules[shape][anchor][first][second].target = NO_ANCHOR;
+                    }
+                    cellMask from = footprint(shape, anchor / Cols, anchor % Cols);
+                    t.cells[shape][anchor] = from;
+                    if (!from)
+                        continue;
+
+                    for (int first = 0; first < 4; first++) {
+                        int midRow = anchor / Cols + rowStep[first];
+                        int midCol = anchor % Cols + colStep[first];
+                        cellMask mid = footprint(shape, midRow, midCol);
+                        if (!mid)
+                            continue;
+
+                        moveRule& single = t.rules[shape][anchor][first][DIR_NONE];
+                        single.need = mid & ~from;
+                        single.cover = mid & ~from;
+                        single.vacate = from & ~mid;
+                        single.target = uint8_t(midRow * Cols + midCol);
+
+                        for (int second = 0; second < 4; second++) {
+                            // Stepping straight back would return to the start
+                            if ((first ^ 1) == second)
+                                continue;
+                            int row = midRow + rowStep[second];
+                            int col = midCol + colStep[second];
+                            cellMask to = footprint(shape, row, col);
+                            if (!to)
+                                continue;
+
+                            // Every cell passed over on the way must be blank too
+                            moveRule& step = t.rules[shape][anchor][first][second];
+                            step.need = (mid | to) & ~from;
+                            step.cover = to & ~from;
+                            step.vacate = from & ~to;
+                            step.target = uint8_t(row * Cols + col);
+                        }
+                    }
+                }
+            }
+            return t;
+        }
+
+        static constexpr tables TABLES = build();
+};
+
+// The board every search runs on
+typedef boardGeometry<5, 4, classicShapes> classicGeometry;
+typedef classicGeometry::moveRule moveRule;
+
+const int BOARD_ROWS = classicGeometry::ROWS;
+const int BOARD_COLS = classicGeometry::COLS;
+
+// Packed Board Struct
+// Each cell takes its geometry's CELL_BITS: the low nibble is the piece
+// identifier ('0'-'9' -> 0-9, 'b' -> 0xF) and the bits above it the piece shape.
+// Cells are packed row-major, CELLS_PER_WORD to a word, so a classic board
+// (cells 0-9 in word[0], 10-19 in word[1]) is two machine words.
+template <class Geometry>
+struct basicBoard
+{
+    public:
+        uint64_t word[Geometry::WORDS] = {};
+
+        uint8_t cell(int row, int col) const
+        {
+            return cellAt(row * Geometry::COLS + col);
+        }
+
+        uint8_t cellAt(int index) const
+        {
+            return (word[index / Geometry::CELLS_PER_WORD] >> ((index % Geometry::CELLS_PER_WORD) * Geometry::CELL_BITS)) & Geometry::CELL_MASK;
+        }
+
+        void setCell(int row, int col, uint8_t code)
+        {
+            int index = row * Geometry::COLS + col;
+            int shift = (index % Geometry::CELLS_PER_WORD) * Geometry::CELL_BITS;
+            uint64_t& w = word[index / Geometry::CELLS_PER_WORD];
+            w = (w & ~(uint64_t(Geometry::CELL_MASK) << shift)) | (uint64_t(code & Geometry::CELL_MASK) << shift);
+        }
+
+        char at(int row, int col) const
+        {
+            uint8_t id = cell(row, col) & 0x0F;
+            return id == BLANK_CELL ? 'b' : char('0' + id);
+        }
+
+        int shapeAt(int row, int col) const
+        {
+            return cell(row, col) >> 4;
+        }
+
+        bool operator==(const basicBoard& other) const
+        {
+            for (int w = 0; w < Geometry::WORDS; w++) {
+                if (word[w] != other.word[w])
+                    return false;
+            }
+            return true;
+        }
+
+        bool operator!=(const basicBoard& other) const
+        {
+            return !(*this == other);
+        }
+};
+
+typedef basicBoard<classicGeometry> packedBoard;
+
+// Piece Table Struct
+// Registry of every piece on a board, indexed by identifier: its shape and the
+// cell index (row * columns + col) of its top-left anchor. Built once from the
+// starting board and shifted in place as moves are applied.
+const int MAX_PIECES = 10;
+
+struct pieceTable
+{
+    public:
+        uint8_t shape[MAX_PIECES];
+        uint8_t anchor[MAX_PIECES];
+
+        pieceTable()
+        {
+            for (int i = 0; i < MAX_PIECES; i++) {
+                shape[i] = SHAPE_NONE;
+                anchor[i] = NO_ANCHOR;
+            }
+        }
+
+        void move(char identifier, int rowOffset, int colOffset)
+        {
+            anchor[identifier - '0'] += rowOffset * BOARD_COLS + colOffset;
+        }
+};
+
+// Game State Struct
+// A board together with the piece table that describes it
+template <class Geometry>
+struct basicState
+{
+    public:
+        basicBoard<Geometry> board;
+        pieceTable pieces;
+};
+
+typedef basicState<classicGeometry> gameState;
+
+// Node Struct
+// Nodes live in a nodeArena and link to their parent by arena index. The move
+// from the parent (see encodeMove) sits in what would otherwise be padding, so
+// a solution is traced from the links and moves without copying any boards.
+const uint32_t NO_NODE = UINT32_MAX;
+const uint8_t NO_MOVE = 0xFF;
+
+struct node
+{
+    public:
+        gameState state;
+        uint32_t parent;
+        uint8_t move;
+        node(const gameState& state, uint32_t parent = NO_NODE, uint8_t move = NO_MOVE)
+        {
+            this->state = state;
+            this->parent = parent;
+            this->move = move;
+        }
+};
+
+// Solution Path Struct
+// A solution as its start state and one byte per move (see encodeMove). Boards
+// along the way are not stored; solutionReplay regenerates them on demand.
+struct solutionPath
+{
+    public:
+        gameState start;
+        vector<uint8_t> moves;
+        size_t steps() const { return moves.size(); }
+};
+
+// Node Arena Class
+// Bump allocator for search nodes. Nodes are placed in fixed-size chunks that are
+// allocated as the search grows and all freed together when the search ends, so
+// there is no per-node new/delete and no table of node pointers to overflow.
+// Nodes are addressed by a 32-bit index (chunk number, then slot), which also
+// serves as the parent link. allocate() is safe to call from several threads.
+class nodeArena
+{
+    public:
+        nodeArena() : chunks(new atomic<node*>[MAX_CHUNKS])
+        {
+            for (size_t c = 0; c < MAX_CHUNKS; c++)
+                chunks[c].store(NULL, memory_order_relaxed);
+        }
+
+        ~nodeArena() { release(); }
+
+        /// <summary>
+        /// Places a node in the arena
+        /// </summary>
+        /// <returns>uint32_t: the new node's index</returns>
+        uint32_t allocate(const gameState& state, uint32_t parent = NO_NODE, uint8_t move = NO_MOVE)
+        {
+            uint32_t index = count.fetch_add(1, memory_order_relaxed);
+            size_t chunk = index >> CHUNK_BITS;
+            if (chunk >= MAX_CHUNKS)
+                throw bad_alloc();
+
+            // Chunks kept by reset() are reused as they are reached again
+            node* block = chunks[chunk].load(memory_order_acquire);
+            if (!block) {
+                lock_guard<mutex> hold(growing);
+                block = chunks[chunk].load(memory_order_relaxed);
+                if (!block) {
+                    block = static_cast<node*>(::operator new(sizeof(node) * CHUNK_NODES));
+                    chunks[chunk].store(block, memory_order_release);
+                    chunkCount++;
+                }
+            }
+            new (&block[index & CHUNK_MASK]) node(state, parent, move);
+            return index;
+        }
+
+        node& operator[](uint32_t index) { return chunks[index >> CHUNK_BITS].load(memory_order_acquire)[index & CHUNK_MASK]; }
+        const node& operator[](uint32_t index) const { return chunks[index >> CHUNK_BITS].load(memory_order_acquire)[index & CHUNK_MASK]; }
+
+        /// <summary>
+        /// Follows parent links from a node back to the root
+        /// </summary>
+        /// <returns>solutionPath: the root's state and the moves from it to the node</returns>
+        solutionPath trace(uint32_t index) const
+        {
+            solutionPath path;
+            for (; (*this)[index].parent != NO_NODE; index = (*this)[index].parent)
+                path.moves.push_back((*this)[index].move);
+            reverse(path.moves.begin(), path.moves.end());
+            path.start = (*this)[index].state;
+            return path;
+        }
+
+        // Moves from the root to a node
+        int depth(uint32_t index) const
+        {
+            int moves = 0;
+            for (; (*this)[index].parent != NO_NODE; index = (*this)[index].parent)
+                moves++;
+            return moves;
+        }
+
+        /// <summary>
+        /// Frees every node at once. Indices from before the call are invalid.
+        /// </summary>
+        void release()
+        {
+            peak = max(peak, size());
+            peakChunks = chunksAllocated();
+            for (size_t c = 0; c < chunkCount.load(memory_order_relaxed); c++) {
+                ::operator delete(chunks[c].load(memory_order_relaxed));
+                chunks[c].store(NULL, memory_order_relaxed);
+            }
+            chunkCount.store(0, memory_order_relaxed);
+            count.store(0, memory_order_relaxed);
+        }
+
+        /// <summary>
+        /// Empties the arena for another search but keeps its chunks, so a
+        /// long-running process does not allocate them again. The peak figures
+        /// start over. Indices from before the call are invalid.
+        /// </summary>
+        void reset()
+        {
+            count.store(0, memory_order_relaxed);
+            peak = 0;
+            peakChunks = 0;
+        }
+
+        size_t size() const { return min(size_t(count.load(memory_order_relaxed)), chunkCount.load(memory_order_relaxed) * CHUNK_NODES); }
+        // Peak figures, so they still describe a search after release(). Chunks
+        // are counted as the current search reaches them, even if kept from an
+        // earlier one.
+        size_t peakSize() const { return max(peak, size()); }
+        size_t chunksAllocated() const { return max(peakChunks, (size() + CHUNK_NODES - 1) / CHUNK_NODES); }
+        size_t memoryBytes() const { return chunksAllocated() * CHUNK_NODES * sizeof(node) + MAX_CHUNKS * sizeof(atomic<node*>); }
+        // Everything allocated now, including chunks kept by reset()
+        size_t heldBytes() const { return chunkCount.load(memory_order_relaxed) * CHUNK_NODES * sizeof(node) + MAX_CHUNKS * sizeof(atomic<node*>); }
+
+    private:
+        static const uint32_t CHUNK_BITS = 14;
+        static const uint32_t CHUNK_NODES = 1 << CHUNK_BITS;
+        static const uint32_t CHUNK_MASK = CHUNK_NODES - 1;
+        static const size_t MAX_CHUNKS = 1 << 16;     // 2^30 nodes
+
+        unique_ptr<atomic<node*>[]> chunks;
+        atomic<uint32_t> count{ 0 };
+        atomic<size_t> chunkCount{ 0 };     // read by budget checks while workers allocate
+        size_t peak = 0;
+        size_t peakChunks = 0;
+        mutex growing;
+};
+
+// Canonical cell codes (3 bits per cell, 60 bits per board). Pieces of the same
+// shape are interchangeable, so the code records only which part of which shape
+// covers a cell; identifiers are dropped. Keys are only used for deduplication:
+// nodes keep their real boards, so a traced solution stays in the original labels.
+enum canonicalCell : uint8_t
+{
+    CANON_BLANK = 0,
+    CANON_KING = 1,
+    CANON_VERTICAL_TOP = 2,
+    CANON_VERTICAL_BOTTOM = 3,
+    CANON_HORIZONTAL_LEFT = 4,
+    CANON_HORIZONTAL_RIGHT = 5,
+    CANON_SQUARE = 6
+};
+
+/// <summary>
+/// Computes the canonical key of a board: its shape-only encoding, folded
+/// with its left/right mirror image by taking the smaller of the two
+/// </summary>
+/// <param name="board">The board to encode</param>
+/// <returns>uint64_t: key shared by every relabeling and mirror image of the board</returns>
+inline uint64_t canonicalKey(const packedBoard& board)
+{
+    uint64_t key = 0;
+    uint64_t mirror = 0;
+
+    for (int i = 0; i < BOARD_ROWS; i++) {
+        for (int j = 0; j < BOARD_COLS; j++) {
+            uint8_t cell = board.cell(i, j);
+            uint8_t code, mirrorCode;
+
+            if (cell == BLANK_CELL) {
+                code = mirrorCode = CANON_BLANK;
+            }
+            else {
+                switch (cell >> 4) {
+                case SHAPE_KING:
+                    code = mirrorCode = CANON_KING;
+                    break;
+                case SHAPE_VERTICAL:
+                    code = mirrorCode = (i > 0 && board.cell(i - 1, j) == cell) ? CANON_VERTICAL_BOTTOM : CANON_VERTICAL_TOP;
+                    break;
+                case SHAPE_HORIZONTAL:
+                    code = (j > 0 && board.cell(i, j - 1) == cell) ? CANON_HORIZONTAL_RIGHT : CANON_HORIZONTAL_LEFT;
+                    mirrorCode = code == CANON_HORIZONTAL_LEFT ? CANON_HORIZONTAL_RIGHT : CANON_HORIZONTAL_LEFT;
+                    break;
+                default:
+                    code = mirrorCode = CANON_SQUARE;
+                    break;
+                }
+            }
+
+            key |= uint64_t(code) << ((i * BOARD_COLS + j) * 3);
+            mirror |= uint64_t(mirrorCode) << ((i * BOARD_COLS + (BOARD_COLS - 1 - j)) * 3);
+        }
+    }
+
+    return key < mirror ? key : mirror;
+}
+
+// Scrambles a canonical key so every bit of it affects the low bits used for slot indexes
+inline uint64_t hashKey(uint64_t key)
+{
+    uint64_t h = key ^ (key >> 33);
+    h *= 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 29;
+    return h;
+}
+
+// Visited Table Class
+// Open-addressing hash set of canonical board keys with linear probing. The table is
+// sized from an expected-state-count hint; when the load factor passes 1/2 a
+// table twice the size is allocated and the old slots are migrated a few at a
+// time on later inserts, so growth never stalls the search with one big rehash.
+class visitedTable
+{
+    public:
+        visitedTable(size_t expectedStates = 1 << 16)
+        {
+            size_t capacity = 16;
+            while (capacity < expectedStates * 2)
+                capacity <<= 1;
+            slots.assign(capacity, 0);
+        }
+
+        /// <summary>
+        /// Inserts a canonical key if it has not been seen before
+        /// </summary>
+        /// <returns>bool: true if the key was new, false if already visited</returns>
+        bool insert(uint64_t key)
+        {
+            migrateSome();
+
+            uint64_t hash = hashKey(key);
+            if (!oldSlots.empty() && probe(oldSlots, key, hash) != NOT_FOUND)
+                return false;
+
+            size_t mask = slots.size() - 1;
+            size_t i = hash & mask;
+            size_t length = 1;
+            while (!isEmpty(slots[i])) {
+                if (slots[i] == key) {
+                    recordProbe(length);
+                    return false;
+                }
+                i = (i + 1) & mask;
+                length++;
+            }
+            recordProbe(length);
+
+            slots[i] = key;
+            count++;
+            if (count * 2 > slots.size())
+                grow();
+            return true;
+        }
+
+        /// <summary>
+        /// Empties the table for another search, keeping its slots allocated
+        /// </summary>
+        void clear()
+        {
+            vector<uint64_t>().swap(oldSlots);
+            fill(slots.begin(), slots.end(), 0);
+            migrated = 0;
+            count = 0;
+            probes = 0;
+            totalProbeLength = 0;
+            longestProbe = 0;
+        }
+
+        bool contains(uint64_t key) const
+        {
+            uint64_t hash = hashKey(key);
+            if (probe(slots, key, hash) != NOT_FOUND)
+                return true;
+            return !oldSlots.empty() && probe(oldSlots, key, hash) != NOT_FOUND;
+        }
+
+        size_t size() const { return count; }
+        size_t capacity() const { return slots.size(); }
+        double loadFactor() const { return double(count) / slots.size(); }
+        double averageProbeLength() const { return probes ? double(totalProbeLength) / probes : 0.0; }
+        size_t maxProbeLength() const { return longestProbe; }
+        size_t memoryBytes() const { return (slots.capacity() + oldSlots.capacity()) * sizeof(uint64_t); }
+
+    private:
+        static const size_t NOT_FOUND = SIZE_MAX;
+        static const size_t MIGRATE_STEP = 16;
+
+        vector<uint64_t> slots;
+        vector<uint64_t> oldSlots;
+        size_t migrated = 0;
+        size_t count = 0;
+        size_t probes = 0;
+        size_t totalProbeLength = 0;
+        size_t longestProbe = 0;
+
+        static bool isEmpty(uint64_t key)
+        {
+            // Every real board has a king, so a zero key never names a valid state
+            return key == 0;
+        }
+
+        static size_t probe(const vector<uint64_t>& table, uint64_t key, uint64_t hash)
+        {
+            size_t mask = table.size() - 1;
+            for (size_t i = hash & mask; !isEmpty(table[i]); i = (i + 1) & mask) {
+                if (table[i] == key)
+                    return i;
+            }
+            return NOT_FOUND;
+        }
+
+        void recordProbe(size_t length)
+        {
+            probes++;
+            totalProbeLength += length;
+            if (length > longestProbe)
+                longestProbe = length;
+        }
+
+        void grow()
+        {
+            // Finish any migration still in flight before starting another
+            while (!oldSlots.empty())
+                migrateSome();
+
+            oldSlots.swap(slots);
+            slots.assign(oldSlots.size() * 2, 0);
+            migrated = 0;
+        }
+
+        void migrateSome()
+        {
+            if (oldSlots.empty())
+                return;
+
+            size_t mask = slots.size() - 1;
+            size_t end = min(migrated + MIGRATE_STEP, oldSlots.size());
+            for (; migrated < end; migrated++) {
+                uint64_t key = oldSlots[migrated];
+                if (isEmpty(key))
+                    continue;
+                size_t i = hashKey(key) & mask;
+                while (!isEmpty(slots[i]))
+                    i = (i + 1) & mask;
+                slots[i] = key;
+            }
+
+            if (migrated == oldSlots.size())
+                vector<uint64_t>().swap(oldSlots);
+        }
+};
+
+// Transposition Table Class
+// Fixed-size, direct-mapped cache used by IDA*. Each entry remembers the smallest
+// depth a state has been reached at and the iteration it was last searched in (so
+// longer paths and repeats are pruned), and the best lower bound on its distance
+// to the goal backed up from earlier iterations. Entries are
+// overwritten on collision, so memory stays constant however large the state
+// space is; a lost entry only costs a re-search.
+class transpositionTable
+{
+    public:
+        struct entry
+        {
+            uint64_t key = 0;
+            int32_t iteration = -1;
+            int16_t g = 0;
+            int16_t h = 0;
+        };
+
+        transpositionTable(size_t entries = 1 << 18)
+        {
+            size_t capacity = 16;
+            while (capacity < entries)
+                capacity <<= 1;
+            slots.assign(capacity, entry());
+        }
+
+        /// <summary>
+        /// Looks up a key without disturbing the table
+        /// </summary>
+        /// <returns>entry*: the key's entry, or NULL if it is not cached</returns>
+        const entry* find(uint64_t key) const
+        {
+            const entry& e = slots[hashKey(key) & (slots.size() - 1)];
+            return e.key == key ? &e : NULL;
+        }
+
+        /// <summary>
+        /// Returns the entry for a key, evicting whatever else occupied its slot
+        /// </summary>
+        entry& claim(uint64_t key)
+        {
+            entry& e = slots[hashKey(key) & (slots.size() - 1)];
+            if (e.key != key) {
+                e = entry();
+                e.key = key;
+            }
+            return e;
+        }
+
+        size_t memoryBytes() const { return slots.capacity() * sizeof(entry); }
+
+    private:
+        vector<entry> slots;
+};
+
+// Concurrent Table Class
+// Lock-free map from canonical keys to a value that only ever decreases, shared by
+// the threads of the parallel searches. Every thread that reaches a key lowers its
+// value with an atomic fetch-min. The parallel BFS stores successor ordinals, so
+// once a layer is expanded the lowest ordinal (the successor a serial scan would
+// have met first) keeps the state; the parallel depth-first driver stores depths.
+// The table does not grow while threads are inserting: the BFS grows it between
+// layers, and the depth-first driver sizes it up front.
+class concurrentTable
+{
+    public:
+        concurrentTable(size_t expectedStates = 1 << 16)
+        {
+            allocate(expectedStates);
+        }
+
+        /// <summary>
+        /// Makes room for a number of states. Not thread safe: call between layers.
+        /// </summary>
+        void reserve(size_t states)
+        {
+            if (states * 2 <= capacity)
+                return;
+
+            unique_ptr<slot[]> old = move(slots);
+            size_t oldCapacity = capacity;
+            allocate(states);
+            count.store(0, memory_order_relaxed);
+            for (size_t i = 0; i < oldCapacity; i++) {
+                uint64_t key = old[i].key.load(memory_order_relaxed);
+                if (key != 0) {
+                    size_t slot = find(key);
+                    slots[slot].key.store(key, memory_order_relaxed);
+                    slots[slot].owner.store(0, memory_order_relaxed);
+                    count.fetch_add(1, memory_order_relaxed);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Inserts a key if needed and offers an owner ordinal for it
+        /// </summary>
+        /// <returns>size_t: the key's slot, used to read back the winning owner</returns>
+        size_t claim(uint64_t key, uint64_t ordinal)
+        {
+            size_t i = locate(key);
+            lower(i, ordinal);
+            return i;
+        }
+
+        /// <summary>
+        /// Inserts a key if needed and lowers its value
+        /// </summary>
+        /// <returns>uint64_t: the value before this call, UINT64_MAX if the key is new</returns>
+        uint64_t offer(uint64_t key, uint64_t value)
+        {
+            return lower(locate(key), value);
+        }
+
+        uint64_t owner(size_t slot) const { return slots[slot].owner.load(memory_order_relaxed); }
+
+        /// <summary>
+        /// Marks a slot as belonging to a finished layer; later claims never win it
+        /// </summary>
+        void settle(size_t slot)
+        {
+            slots[slot].owner.store(0, memory_order_relaxed);
+        }
+
+        size_t size() const { return count.load(memory_order_relaxed); }
+        size_t memoryBytes() const { return capacity * sizeof(slot); }
+
+    private:
+        struct slot
+        {
+            atomic<uint64_t> key;
+            atomic<uint64_t> owner;
+        };
+
+        unique_ptr<slot[]> slots;
+        size_t capacity = 0;
+        atomic<size_t> count{ 0 };
+
+        // Slot holding a key, inserting it into the first empty slot of its run
+        size_t locate(uint64_t key)
+        {
+            size_t mask = capacity - 1;
+            for (size_t i = hashKey(key) & mask;; i = (i + 1) & mask) {
+                uint64_t current = slots[i].key.load(memory_order_acquire);
+                if (current == 0) {
+                    if (slots[i].key.compare_exchange_strong(current, key, memory_order_acq_rel)) {
+                        count.fetch_add(1, memory_order_relaxed);
+                        return i;
+                    }
+                }
+                if (current == key)
+                    return i;
+            }
+        }
+
+        // Atomic fetch-min on a slot's value, returning the value it replaced
+        uint64_t lower(size_t slot, uint64_t value)
+        {
+            uint64_t owner = slots[slot].owner.load(memory_order_relaxed);
+            while (value < owner && !slots[slot].owner.compare_exchange_weak(owner, value, memory_order_relaxed))
+                ;
+            return owner;
+        }
+
+        void allocate(size_t states)
+        {
+            capacity = 16;
+            while (capacity < states * 2)
+                capacity <<= 1;
+            slots.reset(new slot[capacity]);
+            for (size_t i = 0; i < capacity; i++) {
+                slots[i].key.store(0, memory_order_relaxed);
+                slots[i].owner.store(UINT64_MAX, memory_order_relaxed);
+            }
+        }
+
+        // Slot for a key during a rehash, where only settled keys are present
+        size_t find(uint64_t key) const
+        {
+            size_t mask = capacity - 1;
+            size_t i = hashKey(key) & mask;
+            while (slots[i].key.load(memory_order_relaxed) != 0)
+                i = (i + 1) & mask;
+            return i;
+        }
+};
+
+// Worker Pool Class
+// A fixed set of threads that run the same task once per worker and then wait
+// for the next one, so a search does not pay for thread creation at every layer.
+class workerPool
+{
+    public:
+        workerPool(int threads)
+        {
+            // If a thread cannot be started, the ones already running are joined
+            // before the error propagates
+            try {
+                for (int w = 0; w < threads; w++)
+                    workers.push_back(thread(&workerPool::work, this, w));
+            }
+            catch (...) {
+                shutdown();
+                throw;
+            }
+        }
+
+        ~workerPool() { shutdown(); }
+
+        int size() const { return int(workers.size()); }
+
+        /// <summary>
+        /// Runs task(worker) on every worker and returns when all have finished.
+        /// If a task throws, the first exception is rethrown here once all are done.
+        /// </summary>
+        void run(const function<void(int)>& task)
+        {
+            unique_lock<mutex> hold(lock);
+            current = &task;
+            pending = int(workers.size());
+            generation++;
+            wake.notify_all();
+            done.wait(hold, [this] { return pending == 0; });
+            current = NULL;
+            if (failure) {
+                exception_ptr thrown = failure;
+                failure = NULL;
+                rethrow_exception(thrown);
+            }
+        }
+
+    private:
+        vector<thread> workers;
+        mutex lock;
+        condition_variable wake;
+        condition_variable done;
+        const function<void(int)>* current = NULL;
+        size_t generation = 0;
+        int pending = 0;
+        bool stopping = false;
+        exception_ptr failure;
+
+        void shutdown()
+        {
+            {
+                lock_guard<mutex> hold(lock);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (size_t w = 0; w < workers.size(); w++)
+                workers[w].join();
+        }
+
+        void work(int worker)
+        {
+            size_t seen = 0;
+            while (true) {
+                const function<void(int)>* task;
+                {
+                    unique_lock<mutex> hold(lock);
+                    wake.wait(hold, [&] { return stopping || generation != seen; });
+                    if (stopping)
+                        return;
+                    seen = generation;
+                    task = current;
+                }
+
+                exception_ptr thrown;
+                try {
+                    (*task)(worker);
+                }
+                catch (...) {
+                    thrown = current_exception();
+                }
+
+                lock_guard<mutex> hold(lock);
+                if (thrown && !failure)
+                    failure = thrown;
+                if (--pending == 0)
+                    done.notify_one();
+            }
+        }
+};
+
+// Search Frame Struct
+// Bookkeeping for one state in a parallel IDA* iteration. outstanding counts the
+// state itself plus its children still being searched, on whichever worker holds
+// them. When it drops to zero the whole subtree is done, and best (the smallest f
+// cut anywhere below) is a proven lower bound that is backed up to the parent.
+struct searchFrame
+{
+    public:
+        searchFrame* parent;
+        uint64_t key;
+        int g;
+        atomic<int> outstanding;
+        atomic<int> best;
+        searchFrame(searchFrame* parent, uint64_t key, int g)
+            : parent(parent), key(key), g(g), outstanding(1), best(INT_MAX)
+        {
+        }
+};
+
+// Stealing Deque Struct
+// One per worker in the parallel depth-first driver. The owner pushes and pops
+// subtrees at the back; idle workers steal the oldest, largest subtrees from the front.
+struct stealingDeque
+{
+    public:
+        struct item
+        {
+            uint32_t n;
+            int g;
+            searchFrame* frame;     // NULL in a plain DFS
+        };
+
+        mutex lock;
+        deque<item> items;
+};
+
+// One byte per move: piece id * 20 + first direction * 5 + second direction,
+// so every move of every piece fits below NO_MOVE
+inline uint8_t moveCode(int id, int direction, int secondDirection)
+{
+    return uint8_t((id * 4 + direction) * 5 + secondDirection);
+}
+
+// Successor Struct
+// A state produced by the move generator and the move that produced it.
+// A classic board has exactly BOARD_BLANKS blanks (parseBoard rejects any
+// other). Each one-cell move then needs a blank beside the piece, so a board
+// has at most 2 * 4 of them. Each one-cell move extends to a second cell in at
+// most one way, so 16 successors at most; MAX_SUCCESSORS leaves room to spare.
+const int BOARD_BLANKS = 2;
+const int MAX_SUCCESSORS = 32;
+const int MAX_ANY_SUCCESSORS = MAX_PIECES * 4 * 4;     // every piece, every one- and two-cell slide
+
+template <class Geometry>
+struct basicSuccessor
+{
+    public:
+        basicState<Geometry> state;
+        char piece;
+        uint8_t direction;
+        uint8_t secondDirection;    // DIR_NONE for a one-cell move
+
+        uint8_t move() const { return moveCode(piece - '0', direction, secondDirection); }
+};
+
+typedef basicSuccessor<classicGeometry> successor;
+
+// Move generator templates, for any geometry. The classic functions below them
+// (blankMask, generateSuccessors, slidePiece, checkGoal) are these compiled
+// against classicGeometry's tables, which is the path every search takes.
+
+/// <summary>
+/// Finds the blank cells of a board
+/// </summary>
+template <class Geometry>
+inline typename Geometry::cellMask blankCells(const basicBoard<Geometry>& board)
+{
+    // Word by word with constant shifts, so the classic board unrolls fully
+    typename Geometry::cellMask mask = 0;
+    for (int w = 0; w < Geometry::WORDS; w++) {
+        for (int k = 0; k < Geometry::CELLS_PER_WORD; k++) {
+            int c = w * Geometry::CELLS_PER_WORD + k;
+            if (c < Geometry::CELLS && ((board.word[w] >> (k * Geometry::CELL_BITS)) & Geometry::CELL_MASK) == BLANK_CELL)
+                mask |= typename Geometry::cellMask(1) << c;
+        }
+    }
+    return mask;
+}
+
+/// <summary>
+/// Moves a piece by a move rule the caller has already checked is legal
+/// </summary>
+template <class Geometry>
+inline void slideMove(basicState<Geometry>& state, int id, const typename Geometry::moveRule& rule)
+{
+    uint8_t pieceCell = uint8_t((state.pieces.shape[id] << 4) | id);
+    for (typename Geometry::cellMask cells = rule.vacate | rule.cover; cells; cells &= cells - 1) {
+        int c = lowestCell(cells);
+        state.board.setCell(c / Geometry::COLS, c % Geometry::COLS, (rule.vacate >> c) & 1 ? BLANK_CELL : pieceCell);
+    }
+    state.pieces.anchor[id] = rule.target;
+}
+
+/// <summary>
+/// Generates every legal successor of a state in one pass: each piece one cell
+/// in each direction, and from every legal first step a second step, so two-cell
+/// and L-shaped slides are found too
+/// </summary>
+/// <param name="out">Room for MAX_SUCCESSORS entries on a board parseBoard
+/// accepts; MAX_ANY_SUCCESSORS on any other</param>
+/// <returns>int: number of successors written to out</returns>
+template <class Geometry>
+inline int generateMoves(const basicState<Geometry>& state, basicSuccessor<Geometry>* out)
+{
+    typename Geometry::cellMask blanks = blankCells(state.board);
+    int count = 0;
+
+    for (int id = 0; id < MAX_PIECES; id++) {
+        int anchor = state.pieces.anchor[id];
+        if (anchor == NO_ANCHOR)
+            continue;
+        int shape = state.pieces.shape[id];
+
+        for (int first = 0; first < 4; first++) {
+            const typename Geometry::moveRule& step = Geometry::rule(shape, anchor, first, DIR_NONE);
+            if (step.target == NO_ANCHOR || (step.need & blanks) != step.need)
+                continue;
+
+            for (int second = 0; second <= DIR_NONE; second++) {
+                const typename Geometry::moveRule& rule = second == DIR_NONE ? step : Geometry::rule(shape, anchor, first, second);
+                if (rule.target == NO_ANCHOR || (rule.need & blanks) != rule.need)
+                    continue;
+
+                basicSuccessor<Geometry>& s = out[count++];
+                s.state = state;
+                s.piece = char('0' + id);
+                s.direction = uint8_t(first);
+                s.secondDirection = uint8_t(second);
+                slideMove(s.state, id, rule);
+            }
+        }
+    }
+
+    return count;
+}
+
+/// <summary>
+/// Checks whether the king (piece 0) covers the exit cells
+/// </summary>
+template <class Geometry>
+inline bool reachedGoal(const basicBoard<Geometry>& board)
+{
+    for (typename Geometry::cellMask cells = Geometry::pieceCells(SHAPE_KING, Geometry::GOAL_ANCHOR); cells; cells &= cells - 1) {
+        if ((board.cellAt(lowestCell(cells)) & 0x0F) != 0)
+            return false;
+    }
+    return true;
+}
+
+// Mapped File Class
+// A read-only view of a whole file through the OS page cache (mmap on POSIX,
+// MapViewOfFile on Windows). Opening costs a few system calls whatever the file
+// size; pages are read in as they are first touched.
+class mappedFile
+{
+    public:
+        mappedFile() {}
+        mappedFile(const mappedFile&) = delete;
+        mappedFile& operator=(const mappedFile&) = delete;
+        ~mappedFile() { close(); }
+
+        bool open(const string& file, string& error)
+        {
+            close();
+#ifdef _WIN32
+            fileHandle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            LARGE_INTEGER fileSize;
+            if (fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+                error = "cannot open " + file;
+                close();
+                return false;
+            }
+            mapping = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+            view = mapping ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : NULL;
+            if (!view) {
+                error = "cannot map " + file;
+                close();
+                return false;
+            }
+            length = size_t(fileSize.QuadPart);
+#else
+            int descriptor = ::open(file.c_str(), O_RDONLY);
+            struct stat status;
+            if (descriptor < 0 || fstat(descriptor, &status) != 0 || status.st_size == 0) {
+                error = "cannot open " + file;
+                if (descriptor >= 0)
+                    ::close(descriptor);
+                return false;
+            }
+            void* address = mmap(NULL, size_t(status.st_size), PROT_READ, MAP_SHARED, descriptor, 0);
+            ::close(descriptor);
+            if (address == MAP_FAILED) {
+                error = "cannot map " + file;
+                return false;
+            }
+            view = static_cast<const char*>(address);
+            length = size_t(status.st_size);
+#endif
+            return true;
+        }
+
+        void close()
+        {
+#ifdef _WIN32
+            if (view)
+                UnmapViewOfFile(view);
+            if (mapping)
+                CloseHandle(mapping);
+            if (fileHandle != INVALID_HANDLE_VALUE)
+                CloseHandle(fileHandle);
+            mapping = NULL;
+            fileHandle = INVALID_HANDLE_VALUE;
+#else
+            if (view)
+                munmap(const_cast<char*>(view), length);
+#endif
+            view = NULL;
+            length = 0;
+        }
+
+        const char* data() const { return view; }
+        size_t size() const { return length; }
+
+    private:
+        const char* view = NULL;
+        size_t length = 0;
+#ifdef _WIN32
+        HANDLE fileHandle = INVALID_HANDLE_VALUE;
+        HANDLE mapping = NULL;
+#endif
+};
+
+// Distance Database Class
+// Distance to the nearest goal for every solvable state of one piece inventory
+// (how many kings, verticals, horizontals and squares), found by a retrograde BFS
+// from all goal boards. A loaded database is a mapped file that is queried in
+// place: the header and the three sections below are used directly from the
+// mapping, with no parsing and no copies.
+//
+// File layout, version 2, native byte order (byteOrder detects a mismatch):
+//   header
+//   buckets[2^bucketBits + 1]   uint32, first entry of each bucket
+//   keys[stateCount]            uint64 canonical keys, grouped by bucket
+//   distances[stateCount]       uint8 moves to the nearest goal
+// A key's bucket is the top bucketBits of hashKey(key). There is a bucket for
+// every one or two states, so a lookup reads one bucket pair and a few keys.
+// Loading checks every section once, so a damaged file is refused rather than
+// read out of bounds.
+class distanceDatabase
+{
+    public:
+        struct header
+        {
+            char magic[4];
+            uint32_t version;
+            uint32_t byteOrder;
+            uint8_t inventory[4];       // pieces of each shape, by pieceShape
+            uint32_t maxDistance;
+            uint32_t indexScheme;
+            uint32_t bucketBits;
+            uint32_t reserved;
+            uint64_t stateCount;
+            uint64_t bucketsOffset;
+            uint64_t keysOffset;
+            uint64_t distancesOffset;
+            uint64_t fileSize;
+        };
+
+        static const uint32_t VERSION = 2;
+        static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+        static const uint32_t INDEX_HASH_BUCKETS = 1;
+
+        distanceDatabase() {}
+        distanceDatabase(const distanceDatabase&) = delete;
+        distanceDatabase& operator=(const distanceDatabase&) = delete;
+
+        /// <summary>
+        /// Looks up a state's distance to the goal
+        /// </summary>
+        /// <returns>int: moves to the nearest goal, or -1 if the state is not in the table</returns>
+        int distance(uint64_t key) const
+        {
+            size_t bucket = size_t(hashKey(key) >> (64 - head->bucketBits));
+            for (uint32_t i = buckets[bucket]; i < buckets[bucket + 1]; i++) {
+                if (keys[i] == key)
+                    return distances[i];
+            }
+            return -1;
+        }
+
+        const header& info() const { return *head; }
+        size_t size() const { return head ? size_t(head->stateCount) : 0; }
+        bool covers(const uint8_t inventory[4]) const { return head && memcmp(inventory, head->inventory, 4) == 0; }
+
+        // Heap held by the database: zero once mapped, since the OS page cache holds the data
+        size_t memoryBytes() const { return image.capacity(); }
+        size_t fileBytes() const { return head ? size_t(head->fileSize) : 0; }
+
+        /// <summary>
+        /// Lays out a new database in memory from (key, distance) pairs
+        /// </summary>
+        void assign(vector<pair<uint64_t, uint8_t>> entries, const uint8_t inventory[4], uint32_t maxDistance)
+        {
+            uint32_t bucketBits = 1;
+            while (bucketBits < 24 && (size_t(2) << bucketBits) < entries.size())
+                bucketBits++;
+            auto bucketOf = [bucketBits](uint64_t key) { return size_t(hashKey(key) >> (64 - bucketBits)); };
+            sort(entries.begin(), entries.end(), [&](const pair<uint64_t, uint8_t>& a, const pair<uint64_t, uint8_t>& b) {
+                size_t left = bucketOf(a.first), right = bucketOf(b.first);
+                return left != right ? left < right : a.first < b.first;
+            });
+
+            size_t bucketCount = (size_t(1) << bucketBits) + 1;
+            header h;
+            memset(&h, 0, sizeof(h));
+            memcpy(h.magic, "HRDB", 4);
+            h.version = VERSION;
+            h.byteOrder = BYTE_ORDER_MARK;
+            memcpy(h.inventory, inventory, 4);
+            h.maxDistance = maxDistance;
+            h.indexScheme = INDEX_HASH_BUCKETS;
+            h.bucketBits = bucketBits;
+            h.stateCount = entries.size();
+            h.bucketsOffset = sizeof(header);
+            h.keysOffset = (h.bucketsOffset + bucketCount * sizeof(uint32_t) + 7) & ~uint64_t(7);
+            h.distancesOffset = h.keysOffset + entries.size() * sizeof(uint64_t);
+            h.fileSize = h.distancesOffset + entries.size();
+
+            mapping.close();
+            image.assign(size_t(h.fileSize), 0);
+            memcpy(image.data(), &h, sizeof(h));
+            uint32_t* bucketStart = reinterpret_cast<uint32_t*>(image.data() + h.bucketsOffset);
+            uint64_t* keyStart = reinterpret_cast<uint64_t*>(image.data() + h.keysOffset);
+            uint8_t* distanceStart = reinterpret_cast<uint8_t*>(image.data() + h.distancesOffset);
+
+            size_t next = 0;
+            for (size_t b = 0; b < bucketCount; b++) {
+                bucketStart[b] = uint32_t(next);
+                while (next < entries.size() && bucketOf(entries[next].first) == b)
+                    next++;
+            }
+            for (size_t i = 0; i < entries.size(); i++) {
+                keyStart[i] = entries[i].first;
+                distanceStart[i] = entries[i].second;
+            }
+
+            string error;
+            attach(image.data(), image.size(), error);
+        }
+
+        bool save(const string& file, string& error) const
+        {
+            ofstream out(file, ios::binary | ios::trunc);
+            if (!out.is_open()) {
+                error = "cannot write " + file;
+                return false;
+            }
+            out.write(reinterpret_cast<const char*>(head), streamsize(head->fileSize));
+            if (!out) {
+                error = "failed writing " + file;
+                return false;
+            }
+            return true;
+        }
+
+        /// <summary>
+        /// Maps a database file and checks its header and section bounds
+        /// </summary>
+        bool load(const string& file, string& error)
+        {
+            vector<char>().swap(image);
+            if (!mapping.open(file, error))
+                return false;
+            if (!attach(mapping.data(), mapping.size(), error)) {
+                error = file + ": " + error;
+                mapping.close();
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        vector<char> image;     // a database built in this process
+        mappedFile mapping;     // a database loaded from disk
+        const header* head = NULL;
+        const uint32_t* buckets = NULL;
+        const uint64_t* keys = NULL;
+        const uint8_t* distances = NULL;
+
+        bool attach(const char* data, size_t size, string& error)
+        {
+            head = NULL;
+            const header* h = reinterpret_cast<const header*>(data);
+            if (size < sizeof(header) || memcmp(h->magic, "HRDB", 4) != 0) {
+                error = "not a distance database";
+                return false;
+            }
+            if (h->version != VERSION) {
+                error = "format version " + to_string(h->version) + ", expected " + to_string(VERSION);
+                return false;
+            }
+            if (h->byteOrder != BYTE_ORDER_MARK) {
+                error = "written on a machine with a different byte order";
+                return false;
+            }
+            if (h->indexScheme != INDEX_HASH_BUCKETS) {
+                error = "unknown index scheme " + to_string(h->indexScheme);
+                return false;
+            }
+            // Every offset is checked against the size before it is added to, so
+            // no sum below can wrap
+            if (h->bucketBits == 0 || h->bucketBits > 24 || h->fileSize != size || h->stateCount > UINT32_MAX
+                || h->maxDistance > UINT8_MAX || h->bucketsOffset < sizeof(header) || h->bucketsOffset % 4 != 0
+                || h->keysOffset % 8 != 0 || h->bucketsOffset > size || h->keysOffset > size || h->distancesOffset > size) {
+                error = "corrupt or truncated";
+                return false;
+            }
+            size_t bucketCount = (size_t(1) << h->bucketBits) + 1;
+            if (h->bucketsOffset + bucketCount * sizeof(uint32_t) > h->keysOffset
+                || h->keysOffset + h->stateCount * sizeof(uint64_t) > h->distancesOffset
+                || h->distancesOffset + h->stateCount > size) {
+                error = "corrupt or truncated";
+                return false;
+            }
+
+            // distance() trusts the sections, so check them once here: the buckets
+            // must split the keys in order, each key must sit in the bucket a lookup
+            // reads, and each distance must be within maxDistance
+            const uint32_t* bucketStart = reinterpret_cast<const uint32_t*>(data + h->bucketsOffset);
+            const uint64_t* keyStart = reinterpret_cast<const uint64_t*>(data + h->keysOffset);
+            const uint8_t* distanceStart = reinterpret_cast<const uint8_t*>(data + h->distancesOffset);
+            if (bucketStart[0] != 0 || bucketStart[bucketCount - 1] != h->stateCount) {
+                error = "corrupt bucket index";
+                return false;
+            }
+            for (size_t b = 0; b + 1 < bucketCount; b++) {
+                if (bucketStart[b] > bucketStart[b + 1]) {
+                    error = "corrupt bucket index";
+                    return false;
+                }
+            }
+            for (size_t b = 0; b + 1 < bucketCount; b++) {
+                for (uint32_t i = bucketStart[b]; i < bucketStart[b + 1]; i++) {
+                    if (size_t(hashKey(keyStart[i]) >> (64 - h->bucketBits)) != b || distanceStart[i] > h->maxDistance) {
+                        error = "corrupt entry " + to_string(i);
+                        return false;
+                    }
+                }
+            }
+
+            head = h;
+            buckets = bucketStart;
+            keys = keyStart;
+            distances = distanceStart;
+            return true;
+        }
+};
+
+// Key Run Classes
+// Runs of canonical keys on disk for the external-memory search: flat files of
+// native-order uint64 keys in ascending order. Both ends go through one block
+// of KEY_BLOCK keys, so memory stays fixed however long the run.
+const size_t KEY_BLOCK = 4096;
+
+class keyRunWriter
+{
+    public:
+        explicit keyRunWriter(const string& file) : out(file, ios::binary | ios::trunc) { block.reserve(KEY_BLOCK); }
+
+        void add(uint64_t key)
+        {
+            block.push_back(key);
+            written++;
+            if (block.size() == KEY_BLOCK)
+                flush();
+        }
+
+        // Writes what is left; false if any write failed
+        bool close()
+        {
+            flush();
+            out.close();
+            return !out.fail();
+        }
+
+        size_t size() const { return written; }
+
+    private:
+        ofstream out;
+        vector<uint64_t> block;
+        size_t written = 0;
+
+        void flush()
+        {
+            out.write(reinterpret_cast<const char*>(block.data()), streamsize(block.size() * sizeof(uint64_t)));
+            block.clear();
+        }
+};
+
+class keyRunReader
+{
+    public:
+        explicit keyRunReader(const string& file) : in(file, ios::binary), block(KEY_BLOCK) { refill(); }
+
+        bool valid() const { return position < filled; }
+        uint64_t key() const { return block[position]; }
+
+        void next()
+        {
+            if (++position == filled)
+                refill();
+        }
+
+        /// <summary>
+        /// Binary search of a whole run for one key, reading only the keys it probes
+        /// </summary>
+        static bool contains(const string& file, uint64_t key)
+        {
+            ifstream in(file, ios::binary | ios::ate);
+            if (!in)
+                return false;
+            size_t low = 0;
+            size_t high = size_t(in.tellg()) / sizeof(uint64_t);
+            while (low < high) {
+                size_t middle = low + (high - low) / 2;
+                uint64_t probe = 0;
+                in.seekg(streamoff(middle * sizeof(uint64_t)));
+                in.read(reinterpret_cast<char*>(&probe), sizeof(probe));
+                if (!in)
+                    return false;
+                if (probe == key)
+                    return true;
+                if (probe < key)
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+            return false;
+        }
+
+    private:
+        ifstream in;
+        vector<uint64_t> block;
+        size_t position = 0;
+        size_t filled = 0;
+
+        void refill()
+        {
+            position = 0;
+            filled = 0;
+            if (!in)
+                return;
+            in.read(reinterpret_cast<char*>(block.data()), streamsize(KEY_BLOCK * sizeof(uint64_t)));
+            filled = size_t(in.gcount()) / sizeof(uint64_t);
+        }
+};
+
+// Spill Directory Class
+// A private directory for the files of one external-memory search, made under
+// a parent directory (the system temporary directory by default) and removed,
+// with everything in it, when the search is done.
+class spillDirectory
+{
+    public:
+        spillDirectory() {}
+        spillDirectory(const spillDirectory&) = delete;
+        spillDirectory& operator=(const spillDirectory&) = delete;
+
+        ~spillDirectory()
+        {
+            error_code code;
+            if (!root.empty())
+                filesystem::remove_all(root, code);
+        }
+
+        bool create(const string& parent, string& error)
+        {
+            // A name no other search uses, in this process or any other
+            static atomic<unsigned> sequence(0);
+#ifdef _WIN32
+            unsigned long process = GetCurrentProcessId();
+#else
+            unsigned long process = (unsigned long)getpid();
+#endif
+            error_code code;
+            filesystem::path base = parent.empty() ? filesystem::temp_directory_path(code) : filesystem::path(parent);
+            filesystem::path made = base / ("huarong-" + to_string(process) + "-" + to_string(sequence++));
+            if (code || !filesystem::create_directory(made, code)) {
+                error = "cannot create a spill directory in " + (parent.empty() ? string("the temporary directory") : parent);
+                return false;
+            }
+            root = made;
+            return true;
+        }
+
+        string file(const string& name) const { return (root / name).string(); }
+
+    private:
+        filesystem::path root;
+};
+
+class searchProgress;
+class searchBudget;
+struct searchWorkspace;
+
+// Search Options Struct
+// Settings passed through to every search; each search reads only what it uses
+struct searchOptions
+{
+    public:
+        int threads = 0;                                // parallel searches, 0 for one per core
+        vector<const distanceDatabase*> databases;      // the database walk picks the one for the board's inventory
+        searchProgress* progress = NULL;                // live counters for a progressReporter, NULL for none
+        searchWorkspace* workspace = NULL;              // arena and visited table to reuse, NULL to build fresh ones
+        double maxSeconds = 0;                          // wall-time budget, 0 for none
+        long maxExpanded = 0;                           // states expanded, 0 for none
+        size_t maxBytes = 0;                            // bytes held by the search's own structures, 0 for none
+        string spillDirectory;                          // parent of the external-memory search's files, empty for the system temporary directory
+};
+
+// Budget a search stopped at, if any
+enum searchLimit
+{
+    LIMIT_NONE = 0,
+    LIMIT_TIME = 1,
+    LIMIT_NODES = 2,
+    LIMIT_MEMORY = 3
+};
+
+// Search Result Struct
+// What every search returns. The interactive report and the batch records are
+// both built from it, so searches themselves print nothing and write no files.
+struct searchResult
+{
+    public:
+        bool solved = false;
+        solutionPath path;          // start and moves to the goal when solved
+        long expanded = 0;          // states expanded
+        size_t peakBytes = 0;       // largest footprint of the search's own structures
+        string stats;               // extra lines for the interactive report
+        string error;               // set when the search could not run at all
+        searchLimit limit = LIMIT_NONE;     // set when a budget stopped the search
+        int deepest = 0;            // with a limit: deepest depth reached
+        int closestKing = -1;       // with a limit: fewest king moves to the goal seen, -1 if unknown
+};
+
+// Search Algorithm Struct
+// One entry per search mode. The interactive menu and the batch CLI both read
+// SEARCH_ALGORITHMS, so a new search only needs a row there.
+struct searchAlgorithm
+{
+    public:
+        const char* name;       // name on the batch command line and in its records
+        const char* tag;        // suffix of the solution file
+        const char* label;      // menu text
+        bool parallel;          // takes a thread count
+        bool database;          // needs a distance database
+        bool optimal;           // always returns a shortest solution
+        searchResult (*run)(const gameState& startState, const searchOptions& options);
+};
+
+// Initial sizing hint for the visited-state table
+const size_t EXPECTED_STATES = 1 << 18;
+
+// The king's top-left anchor when the goal in checkGoal is met
+const int GOAL_ANCHOR = classicGeometry::GOAL_ANCHOR;
+
+// Entries in the IDA* transposition table
+const size_t TRANSPOSITION_ENTRIES = 1 << 18;
+
+// Memory for the external-memory search's key buffers when there is no maxBytes
+const size_t EXTERNAL_MEMORY = size_t(64) << 20;
+
+// Search Workspace Struct
+// Scratch structures the serial searches borrow instead of building their own
+// (see borrowWorkspace), so a long-running caller such as the solver daemon
+// keeps them allocated and warm from one solve to the next. A workspace serves
+// one search at a time.
+struct searchWorkspace
+{
+    public:
+        nodeArena arena;
+        visitedTable visited;
+
+        searchWorkspace() : visited(EXPECTED_STATES) {}
+};
+
+// Every search mode, in menu order (defined in Solver.cpp)
+extern const searchAlgorithm SEARCH_ALGORITHMS[];
+extern const int ALGORITHM_COUNT;
+
+// Variant Result Struct
+// What a search of a board of another geometry returns. Its moves are moveCode
+// bytes: a solutionPath holds classic states only.
+struct variantResult
+{
+    public:
+        bool solved = false;
+        vector<uint8_t> moves;      // from the start to the goal when solved
+        long expanded = 0;          // states expanded
+        size_t peakBytes = 0;       // largest footprint of the search's own structures
+        string error;               // set when the board could not be read
+        searchLimit limit = LIMIT_NONE;     // set when a budget stopped the search
+        int deepest = 0;            // with a limit: deepest depth reached
+};
+
+// Board Variant Struct
+// One entry per geometry the batch CLI solves with --geometry. The searches in
+// SEARCH_ALGORITHMS run on the classic board only; a variant board is read and
+// solved by variantBfs with its own geometry's tables.
+struct boardVariant
+{
+    public:
+        const char* name;       // name on the command line and in the records
+        const char* label;      // help text
+        variantResult (*solve)(istream& input, const searchOptions& options);
+};
+
+// Every variant geometry (defined in Solver.cpp)
+extern const boardVariant BOARD_VARIANTS[];
+extern const int VARIANT_COUNT;
+
+// Prototypes
+
+bool parseBoard(istream& input, gameState& state, string& error);
+searchWorkspace& borrowWorkspace(const searchOptions& options, unique_ptr<searchWorkspace>& scratch);
+bool loadBoard(const string& file, gameState& state, string& error);
+pieceTable buildPieceTable(const packedBoard& board);
+string boardState(const packedBoard& board);
+uint32_t pieceCells(int shape, int anchor);
+const moveRule& lookupMoveRule(int shape, int anchor, int direction, int secondDirection);
+uint32_t blankMask(const packedBoard& board);
+int generateSuccessors(const gameState& state, successor* out);
+void slidePiece(gameState& state, int id, const moveRule& rule);
+int encodeMove(const gameState& from, const gameState& to);
+bool applyMove(gameState& state, uint8_t move);
+solutionPath recordMoves(const vector<gameState>& states);
+searchResult bfs(const gameState& startState, const searchOptions& options);
+searchResult dfs(const gameState& startState, const searchOptions& options);
+int heuristic(const gameState& state);
+int kingDistance(const gameState& state);
+void recordLimit(const searchBudget& budget, const nodeArena& arena, uint32_t root, searchResult& result);
+searchResult astar(const gameState& startState, const searchOptions& options);
+searchResult idastar(const gameState& startState, const searchOptions& options);
+int idaSearch(vector<gameState>& path, int g, int bound, int iteration, transpositionTable& seen, searchResult& result, searchProgress* progress, searchBudget& budget);
+vector<gameState> enumerateGoals(const gameState& state);
+void placeGoalPieces(gameState& state, uint32_t filled, int counts[4], vector<char> ids[4], int blanks, vector<gameState>& goals);
+void replayToRoot(const nodeArena& arena, uint32_t from, gameState current, solutionPath& path);
+searchResult bidirectional(const gameState& startState, const searchOptions& options);
+vector<searchResult> multiSourceSearch(const vector<gameState>& starts, const searchOptions& options);
+void multiSourceGroup(const vector<gameState>& starts, const vector<size_t>& group, const searchOptions& options, long& expanded, vector<searchResult>& results);
+uint32_t parallelBfsSearch(const gameState& startState, workerPool& pool, nodeArena& arena, long& expanded, size_t& explored, size_t& tableBytes, searchProgress* progress, searchBudget& budget);
+searchResult parallelBfs(const gameState& startState, const searchOptions& options);
+int threadCount(int requested);
+void lowerAtomic(atomic<int>& value, int candidate);
+int knownBound(concurrentTable& bounds, uint64_t key);
+void finishFrame(searchFrame* frame, concurrentTable& bounds);
+uint32_t parallelDepthFirst(const gameState& startState, workerPool& pool, int bound, concurrentTable* bounds, int& nextBound, nodeArena& arena, long& expanded, size_t& tableBytes, searchProgress* progress, searchBudget& budget);
+searchResult parallelDfs(const gameState& startState, const searchOptions& options);
+searchResult parallelIdastar(const gameState& startState, const searchOptions& options);
+void pieceInventory(const pieceTable& pieces, uint8_t inventory[4]);
+bool buildDistanceDatabase(const gameState& state, distanceDatabase& database, string& error);
+searchResult databaseWalk(const gameState& startState, const searchOptions& options);
+bool decodeCanonicalKey(uint64_t key, gameState& state);
+bool writeKeyRun(vector<uint64_t>& keys, const string& file, string& error);
+bool mergeKeyRuns(const vector<string>& runs, const vector<string>& exclude, const string& output, size_t& written, string& error);
+searchResult externalBfs(const gameState& startState, const searchOptions& options);
+template <class Geometry> bool parseVariantBoard(istream& input, basicState<Geometry>& state, string& error);
+template <class Geometry> variantResult variantBfs(const basicState<Geometry>& startState, const searchOptions& options);
+template <class Geometry> variantResult solveVariant(istream& input, const searchOptions& options);
+string moveText(uint8_t move);
+int checkGoal(const packedBoard& board);
+pieceShape checkPiece(const pieceTable& pieces, char identifier);
+string tableStats(const visitedTable& close);
+string arenaStats(const nodeArena& arena);
+searchResult runSearch(const searchAlgorithm& algorithm, const gameState& startState, const searchOptions& options);
+const char* limitName(searchLimit limit);
+
+// Solution Replay Class
+// Walks a solutionPath one move at a time from its start state, so consumers
+// see every board of a solution while holding only the current one.
+class solutionReplay
+{
+    public:
+        solutionReplay(const solutionPath& path) : path(path), current(path.start) {}
+
+        const gameState& state() const { return current; }
+        size_t step() const { return done; }
+        bool finished() const { return done == path.moves.size(); }
+
+        /// <summary>
+        /// Applies the next move
+        /// </summary>
+        /// <returns>bool: false at the end, or if the move is not legal on the current state</returns>
+        bool next()
+        {
+            if (finished() || !applyMove(current, path.moves[done]))
+                return false;
+            done++;
+            return true;
+        }
+
+    private:
+        const solutionPath& path;
+        gameState current;
+        size_t done = 0;
+};
+
+// Search instrumentation. Building with HUARONG_NO_STATS (configure with
+// cmake -DHUARONG_NO_STATS=ON) turns SEARCH_STATS off: every search then sees
+// a NULL progress pointer and the compiler drops the counting along with the
+// branches that guard it.
+#ifdef HUARONG_NO_STATS
+const bool SEARCH_STATS = false;
+#else
+const bool SEARCH_STATS = true;
+#endif
+
+// Expansions between two publications of a search's counters
+const long PROGRESS_EVERY = 1024;
+
+// Search Progress Class
+// Live counters of one running search. The search publishes them every
+// PROGRESS_EVERY expansions with relaxed stores (parallel workers add to them
+// instead), so the search loop pays one branch per expansion; a
+// progressReporter thread reads them while the search runs. Phases (an IDA*
+// iteration, tracing the solution) and the frontier size at each depth are
+// kept for the breakdown printed at the end (see progressBreakdown).
+class searchProgress
+{
+    public:
+        struct phase
+        {
+            string name;
+            double ms;
+            uint64_t expanded;
+            uint64_t duplicates;
+        };
+
+        atomic<uint64_t> expanded{ 0 };
+        atomic<uint64_t> duplicates{ 0 };      // successors rejected as already seen
+        atomic<uint64_t> frontier{ 0 };        // states waiting to be expanded
+        atomic<int> depth{ 0 };                // depth (g) of the state being expanded
+        atomic<uint64_t> bytes{ 0 };           // held by the search's own structures
+        atomic<double> averageProbe{ 0 };      // visited-table probe length, 0 if not tracked
+
+        void publish(long expandedSoFar, long duplicatesSoFar, size_t frontierSize, int currentDepth, size_t bytesHeld, double probe = 0)
+        {
+            expanded.store(uint64_t(expandedSoFar), memory_order_relaxed);
+            duplicates.store(uint64_t(duplicatesSoFar), memory_order_relaxed);
+            frontier.store(frontierSize, memory_order_relaxed);
+            depth.store(currentDepth, memory_order_relaxed);
+            bytes.store(bytesHeld, memory_order_relaxed);
+            averageProbe.store(probe, memory_order_relaxed);
+        }
+
+        // Ends the current phase and starts the next
+        void beginPhase(const string& name)
+        {
+            lock_guard<mutex> hold(lock);
+            marks.push_back({ name, chrono::steady_clock::now(), expanded.load(memory_order_relaxed), duplicates.load(memory_order_relaxed) });
+        }
+
+        // Ends the last phase
+        void finish() { beginPhase(""); }
+
+        // Records the size of the next BFS layer
+        void layer(size_t size)
+        {
+            lock_guard<mutex> hold(lock);
+            layers.push_back(size);
+        }
+
+        string currentPhase() const
+        {
+            lock_guard<mutex> hold(lock);
+            return marks.empty() ? string() : marks.back().name;
+        }
+
+        vector<phase> phases() const
+        {
+            lock_guard<mutex> hold(lock);
+            vector<phase> result;
+            for (size_t m = 0; m < marks.size(); m++) {
+                if (marks[m].name.empty())
+                    continue;
+                bool last = m + 1 == marks.size();
+                auto end = last ? chrono::steady_clock::now() : marks[m + 1].at;
+                uint64_t endExpanded = last ? expanded.load(memory_order_relaxed) : marks[m + 1].expanded;
+                uint64_t endDuplicates = last ? duplicates.load(memory_order_relaxed) : marks[m + 1].duplicates;
+                result.push_back({ marks[m].name, chrono::duration<double, milli>(end - marks[m].at).count(),
+                    endExpanded - marks[m].expanded, endDuplicates - marks[m].duplicates });
+            }
+            return result;
+        }
+
+        vector<size_t> layerSizes() const
+        {
+            lock_guard<mutex> hold(lock);
+            return layers;
+        }
+
+    private:
+        struct mark
+        {
+            string name;        // empty for the end of the last phase
+            chrono::steady_clock::time_point at;
+            uint64_t expanded;
+            uint64_t duplicates;
+        };
+
+        mutable mutex lock;
+        vector<mark> marks;
+        vector<size_t> layers;
+};
+
+// Search Budget Class
+// Enforces the limits in searchOptions. Searches check it every PROGRESS_EVERY
+// expansions, where they publish progress, so a limit may be passed by up to
+// that many states. Once a limit is hit spent() stays true and the search
+// unwinds, frees its structures and returns with result.limit set. Parallel
+// workers share one budget: they add their expansions in batches with charge()
+// and poll stopped() between states.
+class searchBudget
+{
+    public:
+        explicit searchBudget(const searchOptions& options)
+            : maxSeconds(options.maxSeconds), maxExpanded(options.maxExpanded), maxBytes(options.maxBytes),
+              started(chrono::steady_clock::now()) {}
+
+        /// <summary>
+        /// Checks a search's running totals against the limits
+        /// </summary>
+        /// <returns>bool: true if the search must stop</returns>
+        bool spent(long expandedSoFar, size_t bytesHeld)
+        {
+            if (stopped())
+                return true;
+            if (maxExpanded > 0 && expandedSoFar >= maxExpanded)
+                stop(LIMIT_NODES);
+            else if (maxBytes > 0 && bytesHeld >= maxBytes)
+                stop(LIMIT_MEMORY);
+            else if (maxSeconds > 0 && chrono::duration<double>(chrono::steady_clock::now() - started).count() >= maxSeconds)
+                stop(LIMIT_TIME);
+            return stopped();
+        }
+
+        // Adds a parallel worker's batch of expansions to the shared total, then checks
+        bool charge(long batch, size_t bytesHeld) { return spent(shared.fetch_add(batch, memory_order_relaxed) + batch, bytesHeld); }
+
+        // Stops the search; the first limit recorded wins
+        void stop(searchLimit limit)
+        {
+            int none = LIMIT_NONE;
+            hit.compare_exchange_strong(none, limit, memory_order_acq_rel);
+        }
+
+        bool stopped() const { return hit.load(memory_order_acquire) != LIMIT_NONE; }
+        searchLimit limit() const { return searchLimit(hit.load(memory_order_acquire)); }
+
+    private:
+        double maxSeconds;
+        long maxExpanded;
+        size_t maxBytes;
+        chrono::steady_clock::time_point started;
+        atomic<long> shared{ 0 };
+        atomic<int> hit{ LIMIT_NONE };
+};
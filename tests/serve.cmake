@@ -0,0 +1,16 @@
+# Runs the solver daemon on a request file over stdin and checks its answers.
+#   cmake -DHUARONG=<exe> -DREQUESTS=<file> -DEXPECT=<regex;regex;...> -P serve.cmake
+# Every regex must match one response line, and the daemon must exit cleanly.
+execute_process(COMMAND ${HUARONG} --serve --workers 2
+    INPUT_FILE ${REQUESTS}
+    OUTPUT_VARIABLE output
+    RESULT_VARIABLE result
+    TIMEOUT 60)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "daemon exited with ${result}:\n${output}")
+endif()
+foreach(pattern ${EXPECT})
+    if(NOT output MATCHES "${pattern}")
+        message(FATAL_ERROR "no response matches ${pattern}:\n${output}")
+    endif()
+endforeach()